@@ -255,23 +255,32 @@ void undoList(int squaresPerSide, int board[], int &move, int &score, Node* &pHe
 }
 
 
+//print the list as its move count down to 1.  This walks the list in a loop instead of by
+//recursion, so a long game cannot overflow the stack.
 bool countList(Node *pTemp,int counter = 0){
     if (pTemp == NULL){
         return false;
     }
+    int length = 0;
+    for (Node *pNode = pTemp; pNode != NULL; pNode = pNode->pNext){
+        length++;
+    }
     if(counter == 0){
         std::cout << "\t" << "List: ";
     }
-    if(countList(pTemp->pNext,++counter)){
-        std::cout << "->";
+    for (int i = counter + length; i > counter; i--){
+        std::cout << i;
+        if (i > counter + 1){
+            std::cout << "->";
+        }
     }
-    std::cout << counter;
-    if(counter == 1){
+    if(counter == 0){
         std::cout << std::endl;
     }
     return true;
 }
 
+
 //get the index of the board;
 int getIndex(int row, int col, int squaresPerSide){
     return row * squaresPerSide + col;
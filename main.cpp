@@ -28,14 +28,169 @@
 #include <iomanip>           // used for setting output field size using setw
 #include <cstdio>            // For sprintf, "printing" to a string
 #include <cstring>           // For c-string functions such as strlen()  
+#include <cctype>            // For toupper() and isdigit(), used reading scripts of moves
 #include <chrono>            // Used in pausing for some milliseconds using sleep_for(...)
 #include <thread>            // Used in pausing for some milliseconds using sleep_for(...)
+#include <cstdint>           // For fixed-size integers such as uint64_t, used for packed boards
+#include <ctime>             // For time(), used to seed random number generators
+#include <atomic>            // For values shared between threads without locks
+#include <vector>            // For arrays whose size is only known when the program runs
+#include <string>            // For std::string
+#include <algorithm>         // For std::min and std::max
+#include <functional>        // For std::function, used to hand work to a thread pool
+#include <map>               // For the glyphs kept by the offscreen renderer
+#include <cmath>             // For floor(), ceil() and sqrt(), used placing glyphs and laying out boards
+#include <mutex>             // For std::mutex and std::condition_variable, used by the thread pool
+#include <condition_variable>
+#include <unistd.h>          // For write(), to send a whole frame of text to the terminal at once
+#include <sys/ioctl.h>       // For the size of the terminal, used by the in-place text display
+#include <csignal>           // For signal(), to stop the game server cleanly on Ctrl-C
+#include <cerrno>            // For errno, to tell a full socket from a failed one
+#if defined(__linux__)
+#include <sys/socket.h>      // For the sockets used by the game server
+#include <sys/un.h>
+#include <sys/epoll.h>       // For waiting on many sockets at once
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>       // For SSE and AVX instructions, used by the SIMD row kernels
+#endif
 
 const int WindowXSize = 400;
 const int WindowYSize = 500;
 const int MaxBoardSize = 12;  // Max number of squares per side
 
 
+//---------------------------------------------------------------------------------------
+// Tracing, for looking at where the time goes in chrome://tracing or ui.perfetto.dev.
+// Put TRACE_SCOPE( "name") at the top of a block to record how long the block takes.  With
+// tracing off (the default) that costs one relaxed load and a branch.  Run with
+// --trace <file> to turn it on: each thread then records into its own buffer, so threads
+// never wait on each other, and the buffers are written as trace-event JSON when the
+// program exits.  The game can exit with its other threads still running, so each buffer
+// has a lock, taken by its thread for every event and by writeTraceFile() at exit.
+struct TraceEvent {
+    const char *name;                // Must be a string literal, or otherwise live until exit
+    long long startNanoseconds;      // Since tracing started
+    long long durationNanoseconds;
+};
+
+struct TraceBuffer {
+    int threadNumber;
+    std::mutex mutex;                // Only ever waited on while the trace file is written
+    std::vector<TraceEvent> events;
+};
+
+std::atomic<bool> tracingEnabled( false);
+std::string traceFileName;
+std::chrono::steady_clock::time_point traceStart;
+std::mutex traceBuffersMutex;                  // Held when a thread records for the first time, and at exit
+std::vector<TraceBuffer *> traceBuffers;
+
+TraceBuffer *threadTraceBuffer()
+{
+    static thread_local TraceBuffer *pBuffer = NULL;
+    if( pBuffer == NULL) {
+        pBuffer = new TraceBuffer;
+        pBuffer->events.reserve( 64 * 1024);
+        std::lock_guard<std::mutex> lock( traceBuffersMutex);
+        pBuffer->threadNumber = (int) traceBuffers.size() + 1;
+        traceBuffers.push_back( pBuffer);
+    }
+    return pBuffer;
+}
+
+class TraceScope {
+	public:
+		TraceScope( const char *theName)
+		{
+			name = theName;
+			active = tracingEnabled.load( std::memory_order_relaxed);
+			if( active) {
+				start = std::chrono::steady_clock::now();
+			}
+		}
+
+		~TraceScope()
+		{
+			if( active) {
+				std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+				TraceEvent event;
+				event.name = name;
+				event.startNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>( start - traceStart).count();
+				event.durationNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>( end - start).count();
+				TraceBuffer *pBuffer = threadTraceBuffer();
+				std::lock_guard<std::mutex> lock( pBuffer->mutex);
+				pBuffer->events.push_back( event);
+			}
+		}
+
+	private:
+		const char *name;
+		bool active;
+		std::chrono::steady_clock::time_point start;
+
+}; //end class TraceScope
+
+#define TRACE_JOIN( a, b) a##b
+#define TRACE_NAME( line) TRACE_JOIN( traceScope, line)
+#define TRACE_SCOPE( name) TraceScope TRACE_NAME( __LINE__)( name)
+
+// Write every thread's events as trace-event JSON ("X" events, times in microseconds).
+// Registered with atexit(), so it also runs when the game exits on x.
+void writeTraceFile()
+{
+    if( !tracingEnabled.load()) {
+        return;
+    }
+    tracingEnabled.store( false);
+    FILE *pFile = fopen( traceFileName.c_str(), "w");
+    if( pFile == NULL) {
+        std::cout << "Could not write trace file " << traceFileName << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock( traceBuffersMutex);
+    size_t eventCount = 0;
+    fprintf( pFile, "{\"traceEvents\":[\n");
+    for( size_t b = 0; b < traceBuffers.size(); b++) {
+        TraceBuffer &buffer = *traceBuffers[ b];
+        std::lock_guard<std::mutex> bufferLock( buffer.mutex);
+        for( size_t e = 0; e < buffer.events.size(); e++) {
+            const TraceEvent &event = buffer.events[ e];
+            fprintf( pFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     eventCount == 0 ? "" : ",\n", event.name, buffer.threadNumber,
+                     event.startNanoseconds / 1000.0, event.durationNanoseconds / 1000.0);
+            eventCount++;
+        }
+    }
+    fprintf( pFile, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose( pFile);
+    std::cout << "Wrote " << eventCount << " trace events from " << traceBuffers.size()
+              << " threads to " << traceFileName << std::endl;
+}
+
+void startTracing( const char *fileName)
+{
+    traceFileName = fileName;
+    traceStart = std::chrono::steady_clock::now();
+    tracingEnabled.store( true);
+    atexit( writeTraceFile);
+}
+
+
+// Draw calls made so far, counted for the performance display
+long long drawCallCount = 0;
+
+template <typename Drawable>
+void drawCounted( sf::RenderWindow &window, const Drawable &drawable,
+                  const sf::RenderStates &states = sf::RenderStates::Default)
+{
+    drawCallCount++;
+    window.draw( drawable, states);
+}
+
+
 //---------------------------------------------------------------------------------------
 class Square {
 	public:
@@ -106,7 +261,7 @@ class Square {
 		void setText( std::string theText) { text = theText; }
 
 		// Utility functions
-		void displayText( sf::RenderWindow *pWindow, sf::Font theFont, sf::Color theColor, int textSize);
+		void displayText( sf::RenderWindow *pWindow, const sf::Font &theFont, sf::Color theColor, int textSize);
 	
 	private:
 		int size;
@@ -131,7 +286,7 @@ class Square {
 // then call it using:  squaresArray[i]->displayText( &window);
 void Square::displayText( 
 		sf::RenderWindow *pWindow,   // The window into which we draw everything
-		sf::Font theFont,            // Font to be used in displaying text   
+		const sf::Font &theFont,     // Font to be used in displaying text, not copied as sf::Font is large
 		sf::Color theColor,          // Color of the font
 		int textSize)                // Size of the text to be displayed
 {	
@@ -157,23 +312,157 @@ void Square::displayText(
 	theText.setPosition( theXPosition + offset, theYPosition - offset);
 
 	// Finally draw the Text object in the RenderWindow
-	pWindow->draw( theText);
+	drawCounted( *pWindow, theText);
 }
 
 
+//---------------------------------------------------------------------------------------
+// The font, arial.ttf, built into the program so that it runs from any directory without
+// reading the font file.  The assembler copies the file in when this file is compiled, so
+// compile from the directory that holds arial.ttf.
+__asm__(
+    "    .section .rodata\n"
+    "    .balign 16\n"
+    "embeddedFontStart:\n"
+    "    .incbin \"arial.ttf\"\n"
+    "embeddedFontEnd:\n"
+    "    .previous\n"
+);
+extern "C" const unsigned char embeddedFontStart[];
+extern "C" const unsigned char embeddedFontEnd[];
+
+inline size_t embeddedFontSize() { return embeddedFontEnd - embeddedFontStart; }
+
+const int SquareTextSize = 30;     // Size of the numbers on the squares
+
 //---------------------------------------------------------------------------------------
 // Initialize the font
 void initializeFont( sf::Font &theFont)
 {
-	// Create the global font object from the font file
-	if (!theFont.loadFromFile("arial.ttf"))
+	// Create the global font object from the font built into the program
+	if (!theFont.loadFromMemory( embeddedFontStart, embeddedFontSize()))
 	{
 		std::cout << "Unable to load font. " << std::endl;
 		exit( -1);
 	}	
+	// Draw the digits into the font's texture now, so the first frame does not have to
+	for( char digit = '0'; digit <= '9'; digit++) {
+		theFont.getGlyph( digit, SquareTextSize, false);
+	}
 }
 
 
+//---------------------------------------------------------------------------------------
+// Rules of the game as compile-time policies.
+// The fast move kernels and the simulator take the rules as a template parameter, so each
+// variant is compiled into kernels of its own with its rules built in, rather than checking
+// which rules are in play on every tile.  A rules type gives:
+//    getName()                  name shown in reports
+//    goal( squaresPerSide)      the tile that wins the game
+//    SpawnOutOf, spawnValue()   a new tile is spawnValue( roll) for a roll from 0 to SpawnOutOf-1
+//    canMerge( a, b)            whether two nonzero tiles a and b next to each other combine
+//                               (the combined tile is always a + b)
+// plus the same rules on tile codes, the small numbers the batched simulator keeps per square:
+// tileCode() and tileValue() convert between the two, and canMergeCodes(), mergeCodes() and
+// addTileValues() work on a whole vector of codes at once.
+// The interactive game, the packed 4x4 tables, the AI and the server play ClassicRules.
+
+// The rules of this game: the goal is 1024 on a 4x4 board and doubles for each square more
+// or less per side, up to 2^30 (the largest power of two an int holds, reached at 24x24), a
+// new tile is a 2 or a 4 with equal chance, and equal tiles combine.  Codes are tile exponents.
+struct ClassicRules {
+    static const char *getName() { return "classic"; }
+    static int goal( int squaresPerSide) { return 1024 << std::min( abs( squaresPerSide - 4), 20); }
+
+    static const int SpawnOutOf = 2;
+    static int spawnValue( int roll) { return (roll == 1) ? 4 : 2; }
+    static bool canMerge( int a, int b) { return a == b; }
+
+    static int tileCode( int value) { return (value == 0) ? 0 : __builtin_ctz( value); }
+    static long long tileValue( int code) { return (code == 0) ? 0 : 1LL << code; }
+    template <typename Wide>
+    static void addTileValues( const Wide &codes, Wide &total)
+    {
+        Wide one = {};
+        one += 1;
+        total += (one << codes) & ~one;   // Code 0 is an empty square, worth nothing
+    }
+    template <typename Vector>
+    static Vector canMergeCodes( Vector a, Vector b) { return (Vector)( a == b); }
+    template <typename Vector>
+    static Vector mergeCodes( Vector a, Vector /*b*/) { return a + (unsigned char) 1; }
+};
+
+
+// The rules of the original 2048: a new tile is a 4 only one time in ten, and the goal is
+// twice that of the classic rules, up to the same 2^30.
+struct Rules2048 : ClassicRules {
+    static const char *getName() { return "2048"; }
+    static int goal( int squaresPerSide) { return 2048 << std::min( abs( squaresPerSide - 4), 19); }
+
+    static const int SpawnOutOf = 10;
+    static int spawnValue( int roll) { return (roll == 0) ? 4 : 2; }
+};
+
+
+// Fibonacci rules: tiles are Fibonacci numbers and two tiles combine when they are next to
+// each other in the sequence (1 and 1, 1 and 2, 2 and 3, 3 and 5, ...).  A new tile is a 1 or
+// a 2 with equal chance.  The goal is 1597 on a 4x4 board, one Fibonacci number further for
+// each square more or less per side, up to 1836311903, the largest that fits in an int.
+// Code k is the k-th tile of 1, 2, 3, 5, 8, ...
+struct FibonacciRules {
+    static const char *getName() { return "fibonacci"; }
+    static int goal( int squaresPerSide) { return (int) tileValue( 16 + std::min( abs( squaresPerSide - 4), 29)); }
+
+    static const int SpawnOutOf = 2;
+    static int spawnValue( int roll) { return (roll == 1) ? 2 : 1; }
+    // Different Fibonacci numbers are neighbors in the sequence exactly when the larger is at
+    // most twice the smaller, and the only equal neighbors are the two 1s
+    static bool canMerge( int a, int b)
+    {
+        return ((a != b) | (a == 1)) & (a <= 2 * b) & (b <= 2 * a);
+    }
+
+    static int tileCode( int value)
+    {
+        int code = 0;
+        while( tileValue( code) < value) {
+            code++;
+        }
+        return code;
+    }
+    static long long tileValue( int code)
+    {
+        long long previous = 1, value = (code == 0) ? 0 : 1;
+        for( int k = 1; k < code; k++) {
+            long long next = previous + value;
+            previous = value;
+            value = next;
+        }
+        return value;
+    }
+    template <typename Wide>
+    static void addTileValues( const Wide &codes, Wide &total)
+    {
+        for( int lane = 0; lane < (int)( sizeof( Wide) / sizeof( total[ 0])); lane++) {
+            total[ lane] += tileValue( codes[ lane]);
+        }
+    }
+    template <typename Vector>
+    static Vector canMergeCodes( Vector a, Vector b)
+    {
+        Vector one = (a ^ a) + (unsigned char) 1;
+        return ((Vector)( a == b) & (Vector)( a == one)) | (Vector)( a == b + one) | (Vector)( b == a + one);
+    }
+    template <typename Vector>
+    static Vector mergeCodes( Vector a, Vector b)
+    {
+        Vector aLarger = (Vector)( a > b);
+        return ((a & aLarger) | (b & ~aLarger)) + (unsigned char) 1;
+    }
+};
+
+
 //--------------------------------------------------------------------
 // Display Instructions
 void displayInstructions()
@@ -189,7 +478,11 @@ void displayInstructions()
 			  << "join to become a new single tile with the value of the sum of the   \n"
 			  << "two originals. This value gets added to the score.  On each move    \n"
 			  << "one new randomly chosen value of 2 or 4 is placed in a random open  \n"
-			  << "square.  User input of x exits the game.                            \n"
+			  << "square.  User input of x exits the game.  For a suggested move,    \n"
+			  << "enter h (quick) or m (Monte Carlo playouts, better on big boards).  \n"
+			  << "Enter l to list every move so far, u to undo a move, y to redo it,  \n"
+			  << "or j followed by a move number to go straight to that move.         \n"
+			  << "Enter f to show or hide the performance display in the window.      \n"
 			  << "  \n";
 }//end displayInstructions()
 
@@ -200,10 +493,7 @@ void displayInstructions()
 void placeRandomPiece( int board[], int squaresPerSide)
 {
     // Randomly choose a piece to be placed (2 or 4)
-    int pieceToPlace = 2;
-    if( rand()%2 == 1) {
-        pieceToPlace = 4;
-    }
+    int pieceToPlace = ClassicRules::spawnValue( rand() % ClassicRules::SpawnOutOf);
     
     // Find an unoccupied square that currently has a 0
     int index;
@@ -215,39 +505,193 @@ void placeRandomPiece( int board[], int squaresPerSide)
     board[ index] = pieceToPlace;
 }//end placeRandomPiece()
 
-//create the Node
-struct Node{
-    int board[MaxBoardSize*MaxBoardSize];
-    int score;
-    int move;
-    Node *pNext;
-};
+//---------------------------------------------------------------------------------------
+// Every position of the game, for undo, redo and jumping to any move.  Storing a whole
+// board per move would cost every square each time, so a full copy of the board's squares
+// (a keyframe) is kept only every KeyframeInterval positions, and each position in
+// between stores just the squares that changed from the one before.  Getting to any position
+// copies the keyframe before it and replays at most KeyframeInterval - 1 sets of changes, so
+// it costs the same at move 5 as at move 100000.  Making a new move after undoing drops the
+// positions after the current one, starting a new branch from there.
+class Timeline {
+	public:
+		Timeline()
+		{
+			current = -1;
+			currentSquaresPerSide = 0;
+			memset( currentBoard, 0, sizeof( currentBoard));
+		}
 
-//add the node for the next 
-void addNode(int squaresPerSide, int board[], int move, int score, Node* &pHead){
-    Node *pTemp = new Node;
-    pTemp->score = score;
-    pTemp->move = move;
-    for ( int i = 0; i < squaresPerSide*squaresPerSide; i++){
-        pTemp->board[i] = board[i];
-    }
-    pTemp->pNext = pHead;
-    pHead = pTemp;
-}
+		// Add a position after the current one, which then becomes the current one
+		void record( int squaresPerSide, int board[], int move, int score)
+		{
+			truncateAfterCurrent();
+
+			TimelineEntry entry;
+			entry.move = move;
+			entry.score = score;
+			entry.squaresPerSide = squaresPerSide;
+			entry.firstChange = (int) changes.size();
+			// A move number that does not go up means the board was reset, starting a new game
+			if( current < 0 || move <= entries[ current].move) {
+				entry.gameStart = current + 1;
+			}
+			else {
+				entry.gameStart = entries[ current].gameStart;
+			}
+
+			// After a change of board size every square is recorded, since none of the old board is kept
+			bool sizeChanged = squaresPerSide != currentSquaresPerSide;
+			for( int i = 0; i < squaresPerSide * squaresPerSide; i++) {
+				if( sizeChanged || board[ i] != currentBoard[ i]) {
+					TimelineChange change;
+					change.index = i;
+					change.value = board[ i];
+					changes.push_back( change);
+					currentBoard[ i] = board[ i];
+				}
+			}
+			currentSquaresPerSide = squaresPerSide;
+
+			entries.push_back( entry);
+			current++;
+			if( current % KeyframeInterval == 0) {
+				keyframeStarts.push_back( keyframes.size());
+				keyframes.insert( keyframes.end(), currentBoard, currentBoard + squaresPerSide * squaresPerSide);
+			}
+		}
+
+		// Step back or forward one position, returning false if there is none
+		bool undo( int &squaresPerSide, int board[], int &move, int &score)
+		{
+			return current > 0 && jumpToPosition( current - 1, squaresPerSide, board, move, score);
+		}
+
+		bool redo( int &squaresPerSide, int board[], int &move, int &score)
+		{
+			return jumpToPosition( current + 1, squaresPerSide, board, move, score);
+		}
+
+		// Go to the given move number of the current game, returning false if it was not played
+		bool jumpToMove( int moveNumber, int &squaresPerSide, int board[], int &move, int &score)
+		{
+			if( current < 0) {
+				return false;
+			}
+			// The positions left to redo can run on past the end of this game into a later one,
+			// whose move numbers start again.  Games follow one another, so gameStart only goes
+			// up along the positions, and the end of this game can be found by binary search.
+			int gameStart = entries[ current].gameStart;
+			int low = current + 1;
+			int high = (int) entries.size();
+			while( low < high) {
+				int middle = (low + high) / 2;
+				if( entries[ middle].gameStart == gameStart) {
+					low = middle + 1;
+				}
+				else {
+					high = middle;
+				}
+			}
+			int gameEnd = low;
+			// Move numbers go up through a game, so the position can be found the same way
+			low = gameStart;
+			high = gameEnd;
+			while( low < high) {
+				int middle = (low + high) / 2;
+				if( entries[ middle].move < moveNumber) {
+					low = middle + 1;
+				}
+				else {
+					high = middle;
+				}
+			}
+			if( low >= gameEnd || entries[ low].move != moveNumber) {
+				return false;
+			}
+			return jumpToPosition( low, squaresPerSide, board, move, score);
+		}
+
+		// Get (accessor) functions
+		int getLength() { return current + 1; }                         // Positions up to the current one
+		int getRedoCount() { return (int) entries.size() - current - 1; }
+		int getMoveAt( int position) { return entries[ position].move; }
+		size_t getMemoryUsed()
+		{
+			return entries.capacity() * sizeof( TimelineEntry) + changes.capacity() * sizeof( TimelineChange) +
+			       keyframes.capacity() * sizeof( int) + keyframeStarts.capacity() * sizeof( size_t) + sizeof( Timeline);
+		}
+
+	private:
+		static const int KeyframeInterval = 64;
+
+		struct TimelineEntry {
+			int move;
+			int score;
+			int squaresPerSide;
+			int firstChange;      // Index in changes of the first square changed by this position
+			int gameStart;        // Position where the game this position belongs to started
+		};
+
+		struct TimelineChange {
+			int index;
+			int value;
+		};
+
+		bool jumpToPosition( int position, int &squaresPerSide, int board[], int &move, int &score)
+		{
+			if( position < 0 || position >= (int) entries.size()) {
+				return false;
+			}
+			// A keyframe holds only the squares of its own board; a change of size in the positions
+			// after it records every square of the new board
+			int keyframe = position / KeyframeInterval;
+			int keyframeSide = entries[ keyframe * KeyframeInterval].squaresPerSide;
+			memcpy( currentBoard, &keyframes[ keyframeStarts[ keyframe]], keyframeSide * keyframeSide * sizeof( int));
+			for( int p = keyframe * KeyframeInterval + 1; p <= position; p++) {
+				int lastChange = (p + 1 < (int) entries.size()) ? entries[ p + 1].firstChange : (int) changes.size();
+				for( int c = entries[ p].firstChange; c < lastChange; c++) {
+					currentBoard[ changes[ c].index] = changes[ c].value;
+				}
+			}
+			current = position;
+			currentSquaresPerSide = entries[ position].squaresPerSide;
+
+			squaresPerSide = currentSquaresPerSide;
+			move = entries[ position].move;
+			score = entries[ position].score;
+			memcpy( board, currentBoard, squaresPerSide * squaresPerSide * sizeof( int));
+			return true;
+		}
+
+		// Drop any positions after the current one, left over from undoing
+		void truncateAfterCurrent()
+		{
+			if( current + 1 < (int) entries.size()) {
+				changes.resize( entries[ current + 1].firstChange);
+				entries.resize( current + 1);
+				int lastKeyframe = current / KeyframeInterval;
+				int lastSide = entries[ lastKeyframe * KeyframeInterval].squaresPerSide;
+				keyframes.resize( keyframeStarts[ lastKeyframe] + lastSide * lastSide);
+				keyframeStarts.resize( lastKeyframe + 1);
+			}
+		}
+
+		std::vector<TimelineEntry> entries;    // One per position, oldest first
+		std::vector<TimelineChange> changes;   // Squares changed by each position, in order
+		std::vector<int> keyframes;            // Whole boards, one every KeyframeInterval positions
+		std::vector<size_t> keyframeStarts;    // Where each keyframe starts in keyframes
+		int current;                           // Position being played, -1 before the first
+		int currentBoard[ MaxBoardSize * MaxBoardSize];   // Board at the current position
+		int currentSquaresPerSide;
+
+}; //end class Timeline
 
 //this function is undo the board, score, and move.
-void undoList(int squaresPerSide, int board[], int &move, int &score, Node* &pHead){
-    Node *pTemp = pHead;   
-	// Next line should be:  if( pTemp->pNext != NULL)
-    if(pTemp->pNext != NULL){
+//the board size is restored too, in case the board was reset to a new size.
+void undoList(int &squaresPerSide, int board[], int &move, int &score, Timeline &timeline){
+    if(timeline.undo(squaresPerSide, board, move, score)){
         std::cout << "* Undoing move *" << std::endl;
-        score = pTemp->pNext->score;
-        move = pTemp->pNext->move;
-        for (int i = 0; i < squaresPerSide*squaresPerSide; i ++){
-            board[i] = pTemp->pNext->board[i];
-        }
-        pHead = pTemp->pNext;
-        delete pTemp;
     }
     else{
         std::cout << "*** You cannot undo past the beginning of the game.  Please retry. ***" << std::endl;
@@ -255,54 +699,586 @@ void undoList(int squaresPerSide, int board[], int &move, int &score, Node* &pHe
 }
 
 
-//this function is make the display list.
-void displayList(Node *pTemp,int counter = 0){
-    std::cout << "List: ";
-    while (pTemp != NULL){
-        std::cout << pTemp->move;
-        if (pTemp->pNext != NULL){
-            std::cout << "->";
+//---------------------------------------------------------------------------------------
+// Check undo, redo and jumping to a move against a plain list of every position, over random
+// runs of moves, undos, redos, jumps and resets to a new board size.  Each run starts with
+// a game, a reset, a second game, and undoing back across the reset into the first game
+// before jumping, so the positions left to redo hold the end of the first game and then all
+// of the second, whose move numbers start again.
+// Run it using:   ./sfml-app --check-timeline
+void checkTimeline()
+{
+    struct Position {
+        int move;
+        int score;
+        int squaresPerSide;
+        int game;
+        int board[ MaxBoardSize * MaxBoardSize];
+    };
+    const int Runs = 200;
+    const int StepsPerRun = 400;
+    long long jumps = 0;
+    long long mismatches = 0;
+    srand( 12345);
+
+    for( int run = 0; run < Runs; run++) {
+        Timeline timeline;
+        std::vector<Position> positions;   // Every position, as the timeline should have them
+        int current = -1;
+        Position now;
+        now.squaresPerSide = 4 + run % (MaxBoardSize - 3);
+        now.move = 0;
+        now.score = 0;
+        now.game = 0;
+        for( int i = 0; i < MaxBoardSize * MaxBoardSize; i++) {
+            now.board[ i] = 0;
+        }
+
+        // Record a position, dropping any left to redo
+        auto record = [&]() {
+            positions.resize( current + 1);
+            positions.push_back( now);
+            current++;
+            timeline.record( now.squaresPerSide, now.board, now.move, now.score);
+        };
+        // The timeline must agree on whether a step could be made, and give the list's position
+        auto compare = [&]( bool expected, bool got, int squaresPerSide, int board[], int move, int score) {
+            const Position &p = positions[ current];
+            if( expected != got || (got && (squaresPerSide != p.squaresPerSide || move != p.move || score != p.score
+                || memcmp( board, p.board, p.squaresPerSide * p.squaresPerSide * sizeof( int)) != 0))) {
+                mismatches++;
+            }
+        };
+
+        record();
+        int firstGameMoves = 1 + run % 20;
+        int resetStep = firstGameMoves;
+        int undoStep = resetStep + 1 + (run * 7) % 40;
+        for( int step = 0; step < StepsPerRun; step++) {
+            int action = rand() % 10;
+            if( step < undoStep) {
+                action = (step == resetStep) ? 9 : 0;
+            }
+            int squaresPerSide = 0;
+            int board[ MaxBoardSize * MaxBoardSize];
+            int move = 0;
+            int score = 0;
+            if( step == undoStep) {
+                // Undo back into the first game, then jump around in it below
+                int target = rand() % (firstGameMoves + 1);
+                while( current > target) {
+                    bool done = timeline.undo( squaresPerSide, board, move, score);
+                    current--;
+                    compare( true, done, squaresPerSide, board, move, score);
+                }
+                action = 7;
+            }
+            if( action <= 4) {
+                // A move: one square changes and the move number goes up
+                now.board[ rand() % (now.squaresPerSide * now.squaresPerSide)] = 2 << (rand() % 10);
+                now.move++;
+                now.score += 4;
+                record();
+            }
+            if( action == 5) {
+                bool expected = current > 0;
+                bool done = timeline.undo( squaresPerSide, board, move, score);
+                current -= expected;
+                compare( expected, done, squaresPerSide, board, move, score);
+                now = positions[ current];
+            }
+            if( action == 6) {
+                bool expected = current + 1 < (int) positions.size();
+                bool done = timeline.redo( squaresPerSide, board, move, score);
+                current += expected;
+                compare( expected, done, squaresPerSide, board, move, score);
+                now = positions[ current];
+            }
+            if( action == 7 || action == 8) {
+                // Jump to every move number the current game could have, and one past
+                int game = positions[ current].game;
+                int lastMove = 0;
+                for( int p = 0; p < (int) positions.size(); p++) {
+                    lastMove = std::max( lastMove, positions[ p].move);
+                }
+                for( int m = 0; m <= lastMove + 1; m++) {
+                    int found = -1;
+                    for( int p = 0; p < (int) positions.size(); p++) {
+                        if( positions[ p].game == game && positions[ p].move == m) {
+                            found = p;
+                        }
+                    }
+                    bool done = timeline.jumpToMove( m, squaresPerSide, board, move, score);
+                    if( found >= 0) {
+                        current = found;
+                    }
+                    jumps++;
+                    compare( found >= 0, done, squaresPerSide, board, move, score);
+                    game = positions[ current].game;
+                }
+                now = positions[ current];
+            }
+            if( action == 9) {
+                // A reset to a new board size, starting a new game at move 0
+                now.squaresPerSide = 4 + rand() % (MaxBoardSize - 3);
+                for( int i = 0; i < MaxBoardSize * MaxBoardSize; i++) {
+                    now.board[ i] = 0;
+                }
+                now.board[ rand() % (now.squaresPerSide * now.squaresPerSide)] = 2;
+                now.move = 0;
+                now.score = 0;
+                now.game = (current < 0) ? 0 : positions[ current].game + 1;
+                record();
+            }
+        }
+    }
+    std::cout << "Timeline: " << Runs << " runs, " << jumps << " jumps, " << mismatches << " wrong" << std::endl;
+}
+
+
+//number of moves shown in the list under the board.  Only the newest ones are shown, so
+//drawing the board costs the same however long the game has gone on.
+const int HistoryShown = 10;
+
+//add the list of moves to text, newest first, showing at most limit of them (0 for all).
+void appendList(std::string &text, Timeline &timeline, int limit = 0){
+    text += "List: ";
+    int length = timeline.getLength();
+    int shown = (limit == 0) ? length : std::min(limit, length);
+    for (int position = length - 1; position >= length - shown; position--){
+        text += std::to_string(timeline.getMoveAt(position));
+        if (position > 0){
+            text += "->";
         }
-        pTemp = pTemp -> pNext;
+    }
+    if (shown < length){
+        text += "... (" + std::to_string(length) + " in all, enter l to see them)";
+    }
+    if (timeline.getRedoCount() > 0){
+        text += "  (" + std::to_string(timeline.getRedoCount()) + " to redo with y)";
     }
 }
 
+//this function is make the display list, showing the whole list.
+void displayList(Timeline &timeline){
+    std::string text;
+    appendList(text, timeline);
+    std::cout << text;
+}
+
 //get the index of the board;
 int getIndex(int row, int col, int squaresPerSide){
     return row * squaresPerSide + col;
 }
 
+// Boards are stored row by row, so moving a column ('W' and 'S') would jump a whole row
+// ahead in memory on every square.  Instead the board is transposed (rows and columns
+// swapped), moved along its rows, and transposed back.  The transpose works on small
+// square blocks, so the rows being read and written stay in the cache even on big boards.
+const int TransposeBlock = 8;
+
+//swap rows and columns of the board in place.  Works on boards of tile values or exponents.
+template <typename Cell>
+void transposeBoard(Cell board[], int squaresPerSide){
+    int n = squaresPerSide;
+    for (int blockRow = 0; blockRow < n; blockRow += TransposeBlock){
+        for (int blockCol = blockRow; blockCol < n; blockCol += TransposeBlock){
+            int rowEnd = std::min(blockRow + TransposeBlock, n);
+            int colEnd = std::min(blockCol + TransposeBlock, n);
+            for (int i = blockRow; i < rowEnd; i++){
+                // On the diagonal only swap the upper half, so nothing is swapped twice
+                for (int j = (blockRow == blockCol) ? i + 1 : blockCol; j < colEnd; j++){
+                    std::swap(board[getIndex(i,j,n)], board[getIndex(j,i,n)]);
+                }
+            }
+        }
+    }
+}
+
+//swap rows and columns of source, putting the result in destination.
+void transposeInto(const int source[], int destination[], int squaresPerSide){
+    int n = squaresPerSide;
+    for (int blockRow = 0; blockRow < n; blockRow += TransposeBlock){
+        for (int blockCol = 0; blockCol < n; blockCol += TransposeBlock){
+            int rowEnd = std::min(blockRow + TransposeBlock, n);
+            int colEnd = std::min(blockCol + TransposeBlock, n);
+            for (int i = blockRow; i < rowEnd; i++){
+                for (int j = blockCol; j < colEnd; j++){
+                    destination[getIndex(j,i,n)] = source[getIndex(i,j,n)];
+                }
+            }
+        }
+    }
+}
+
 //reset the board and return every element into 0.
-int resetBoard(int board[], int squaresPerSide){
+void resetBoard(int board[], int squaresPerSide){
     for (int i = 0 ; i < squaresPerSide*squaresPerSide; i++){
         board[i] = 0;
     }
 }
 
-//display the board to play game.
-void displayBoardSize(int squaresPerSide, int board[], int score, Node* &pHead,int &counter){
-    Node *pTemp = pHead;
-    std::cout << std::endl;
-    std::cout << "Score: " << score << std::endl;
-    
-    //print the board
-    for( int i = 0; i < squaresPerSide*squaresPerSide; i++){
-        if( i % squaresPerSide == 0){
-            std:: cout << "\n";
-            std:: cout << "\n";
-        }
-        if(board[i] ==0){
-            std::cout << "\t" << ".";
-        }
-        else{
-            std::cout << "\t" << board[i];
-        }
-    }
-    std::cout << std::endl;
-    displayList(pTemp,counter);        
-    std::cout << std::endl;
+//---------------------------------------------------------------------------------------
+// Text display of the board.  The whole frame is formatted into one buffer, which keeps its
+// space from frame to frame, and then sent to the terminal with a single write, instead of
+// many small writes to cout that each flush on endl.  That is much faster over ssh.
+// With useAnsi set, a full frame clears the screen and saves the cursor at its top, and
+// later frames move the cursor relative to that saved spot to rewrite only the squares that
+// changed, the score, and the list, so the board stays in place without scrolling or
+// flicker.  Rows are single spaced, and squares closer together than a tab stop, when the
+// board would not otherwise fit the terminal.
+// Anything that makes the screen scroll moves the saved spot, so the next frame is a full
+// one: a frame that runs past the bottom of the terminal sees to that itself, and output
+// written between frames needs forceFullFrame().  Without useAnsi each frame looks just like
+// the original displayBoardSize() output.
+class TextRenderer {
+	public:
+		TextRenderer( bool theUseAnsi = false)
+		{
+			useAnsi = theUseAnsi;
+			frame.reserve( 16 * 1024);
+			previousRowSpacing = 2;
+			previousColumnWidth = 8;
+			terminalRows = 24;
+			terminalColumns = 80;
+			forceFullFrame();
+		}
+
+		// The next frame redraws everything, such as after other output to the terminal
+		void forceFullFrame() { previousSquaresPerSide = 0; }
+
+		bool getUseAnsi() { return useAnsi; }
+
+		void drawFrame( int board[], int squaresPerSide, int score, Timeline &timeline, const std::string &message)
+		{
+			frame.clear();
+			int rowSpacing = 2;
+			int columnWidth = 8;
+			if( useAnsi) {
+				readTerminalSize();
+				rowSpacing = (FirstRowLine + 2 * squaresPerSide + 2 <= terminalRows) ? 2 : 1;
+				columnWidth = std::max( 1, std::min( 8, (terminalColumns - 1) / (squaresPerSide + 1)));
+			}
+			bool fullFrame = !useAnsi || squaresPerSide != previousSquaresPerSide
+			                 || rowSpacing != previousRowSpacing || columnWidth != previousColumnWidth;
+			int listLine = FirstRowLine + rowSpacing * (squaresPerSide - 1) + 1;
+			if( fullFrame) {
+				if( useAnsi) {
+					frame += "\033[H\033[2J\0337";
+				}
+				frame += "\nScore: ";
+				appendNumber( score);
+				frame += "\n";
+				for( int i = 0; i < squaresPerSide * squaresPerSide; i++) {
+					if( i == 0 || (i % squaresPerSide == 0 && rowSpacing == 2)) {
+						frame += "\n\n";
+					}
+					else if( i % squaresPerSide == 0) {
+						frame += "\n";
+					}
+					if( columnWidth == 8) {
+						frame += "\t";
+						appendSquare( board[ i], false, 0);
+					}
+					else {
+						frame.append( (i % squaresPerSide == 0) ? columnWidth : 0, ' ');
+						appendSquare( board[ i], true, columnWidth);
+					}
+				}
+				frame += "\n";
+			}
+			else {
+				if( score != previousScore) {
+					moveCursor( ScoreLine, 1);
+					frame += "Score: ";
+					appendNumber( score);
+					frame += "\033[K";
+				}
+				for( int i = 0; i < squaresPerSide * squaresPerSide; i++) {
+					if( board[ i] != previousBoard[ i]) {
+						// Squares start every columnWidth columns, at each tab stop when that is 8
+						moveCursor( FirstRowLine + rowSpacing * (i / squaresPerSide), columnWidth * (i % squaresPerSide + 1) + 1);
+						appendSquare( board[ i], true, columnWidth - 1);
+					}
+				}
+				moveCursor( listLine, 1);
+			}
+			size_t listStart = frame.size();
+			appendList( frame, timeline, HistoryShown);
+			if( useAnsi) {
+				// The list may have wrapped, so clear from the line after it rather than a fixed line
+				frame += "\033[K\n\033[J";
+			}
+			else {
+				frame += "\n";
+			}
+			if( !message.empty()) {
+				frame += message;
+				frame += "\n";
+			}
+			frame += "\n";
+
+			writeFrame();
+			memcpy( previousBoard, board, squaresPerSide * squaresPerSide * sizeof( int));
+			previousSquaresPerSide = squaresPerSide;
+			previousRowSpacing = rowSpacing;
+			previousColumnWidth = columnWidth;
+			previousScore = score;
+			// The prompt and the player's answer take the line after the frame.  If that is
+			// past the bottom of the terminal, the screen scrolls and the next frame starts over.
+			if( useAnsi && listLine + countLines( listStart) + 1 > terminalRows) {
+				forceFullFrame();
+			}
+		}
+
+	private:
+		// Screen lines, counting from 1, in a frame: a blank line, the score, two blank lines,
+		// then each row of the board, followed by a blank line when rows are double spaced.
+		static const int ScoreLine = 2;
+		static const int FirstRowLine = 5;
+
+		// Terminal size, or the usual 80x24 when it cannot be told, such as when not a terminal
+		void readTerminalSize()
+		{
+			struct winsize size;
+			terminalRows = 24;
+			terminalColumns = 80;
+			if( ioctl( STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+				terminalRows = size.ws_row;
+				terminalColumns = size.ws_col;
+			}
+		}
+
+		// Number of lines the cursor moves down while the frame from start onwards is shown,
+		// counting lines that wrap at the edge of the terminal.  Escape sequences take no space.
+		int countLines( size_t start)
+		{
+			int lines = 0;
+			int column = 0;
+			for( size_t i = start; i < frame.size(); i++) {
+				char c = frame[ i];
+				if( c == '\033') {
+					// Skip a control sequence up to its final letter, or a two-character escape
+					if( i + 1 < frame.size() && frame[ i + 1] == '[') {
+						i += 2;
+						while( i < frame.size() && !isalpha( (unsigned char) frame[ i])) {
+							i++;
+						}
+					}
+					else {
+						i++;
+					}
+				}
+				else if( c == '\n') {
+					lines++;
+					column = 0;
+				}
+				else {
+					column = (c == '\t') ? (column / 8 + 1) * 8 : column + 1;
+					if( column >= terminalColumns) {
+						lines++;
+						column = 0;
+					}
+				}
+			}
+			return lines;
+		}
+
+		void appendNumber( int value)
+		{
+			char digits[ 16];
+			int length = snprintf( digits, sizeof( digits), "%d", value);
+			frame.append( digits, length);
+		}
+
+		// Squares are a '.' when empty.  With pad set they are padded with spaces to width
+		// characters, such as when overwriting an old value, so no digits of it are left behind.
+		void appendSquare( int value, bool pad, int width)
+		{
+			size_t start = frame.size();
+			if( value == 0) {
+				frame += ".";
+			}
+			else {
+				appendNumber( value);
+			}
+			if( pad && (int)( frame.size() - start) < width) {
+				frame.append( width - (frame.size() - start), ' ');
+			}
+		}
+
+		// Move to a line of the frame, counting from 1, from the spot saved at its top
+		void moveCursor( int line, int column)
+		{
+			char sequence[ 48];
+			int length = snprintf( sequence, sizeof( sequence), "\0338\033[%dB\033[%dG", line - 1, column);
+			frame.append( sequence, length);
+		}
+
+		// Anything already waiting in cout or stdout goes first, so the output stays in order
+		void writeFrame()
+		{
+			std::cout.flush();
+			fflush( stdout);
+			const char *pNext = frame.data();
+			size_t remaining = frame.size();
+			while( remaining > 0) {
+				ssize_t written = write( STDOUT_FILENO, pNext, remaining);
+				if( written <= 0) {
+					break;
+				}
+				pNext += written;
+				remaining -= written;
+			}
+		}
+
+		bool useAnsi;
+		std::string frame;                                  // Kept between frames to reuse its space
+		int previousBoard[ MaxBoardSize * MaxBoardSize];    // As last drawn, to find what changed
+		int previousSquaresPerSide;                         // 0 when there is no frame to update
+		int previousRowSpacing;
+		int previousColumnWidth;
+		int previousScore;
+		int terminalRows;
+		int terminalColumns;
+
+}; //end class TextRenderer
+
+
+//display the board to play game: the score, the board and the list of moves, followed by any
+//message for the user.
+void displayBoardSize(int squaresPerSide, int board[], int score, Timeline &timeline, TextRenderer &renderer,
+                      const std::string &message = ""){
+    renderer.drawFrame(board, squaresPerSide, score, timeline, message);
+}
+
+//---------------------------------------------------------------------------------------
+// Performance display, drawn over the bottom of the window when turned on with --hud or
+// the f key.  The main loop times each phase of a frame with steady_clock, which costs well
+// under a microsecond a reading, and hands the times in here.  Frame times are kept for the
+// last HudFramesKept frames so their percentiles show the slow frames and not just the average.
+double millisecondsSince( std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start).count();
 }
 
+// When the program started, as near as can be told: set while the program is being loaded,
+// before main() runs
+const std::chrono::steady_clock::time_point programStart = std::chrono::steady_clock::now();
+
+const int HudFramesKept = 240;
+
+class PerformanceHud {
+	public:
+		PerformanceHud( bool theIsVisible = false)
+		{
+			isVisible = theIsVisible;
+			frameCount = 0;
+			lastDrawCalls = 0;
+			lastRender = 0;
+			lastTextDisplay = 0;
+			lastMove = 0;
+			moveCount = 0;
+			moveTotal = 0;
+			windowCreation = 0;
+			fontLoad = 0;
+			firstFrame = 0;
+		}
+
+		bool getIsVisible() { return isVisible; }
+		void toggle() { isVisible = !isVisible; }
+		int getFrameCount() { return frameCount; }
+
+		// Frame time covers building and drawing the squares and showing the window; render
+		// time is the part from clearing the window to showing it.
+		void addFrame( double frameMilliseconds, double renderMilliseconds, long long drawCalls)
+		{
+			frameTimes[ frameCount % HudFramesKept] = frameMilliseconds;
+			frameCount++;
+			lastRender = renderMilliseconds;
+			lastDrawCalls = drawCalls;
+		}
+
+		void addTextDisplay( double milliseconds) { lastTextDisplay = milliseconds; }
+
+		// For passing the move times from the game's thread to the render thread's display
+		double getLastMove() { return lastMove; }
+		double getMoveTotal() { return moveTotal; }
+		long long getMoveCount() { return moveCount; }
+		double getLastTextDisplay() { return lastTextDisplay; }
+		void setMoveTimes( double theLastMove, double theMoveTotal, long long theMoveCount)
+		{
+			lastMove = theLastMove;
+			moveTotal = theMoveTotal;
+			moveCount = theMoveCount;
+		}
+
+		// How long the window and the font took to set up, and the time from the start of
+		// the program to the first frame being shown
+		void setStartup( double windowMilliseconds, double fontMilliseconds, double firstFrameMilliseconds)
+		{
+			windowCreation = windowMilliseconds;
+			fontLoad = fontMilliseconds;
+			firstFrame = firstFrameMilliseconds;
+		}
+
+		// Time to work out a move (the boards after all four, on whichever thread did it) and
+		// make it on the board
+		void addMove( double milliseconds)
+		{
+			lastMove = milliseconds;
+			moveTotal += milliseconds;
+			moveCount++;
+		}
+
+		std::string describe( size_t historyBytes, int historyLength)
+		{
+			char line[ 256];
+			std::string text;
+			snprintf( line, sizeof( line), "frame ms p50 %.2f p95 %.2f p99 %.2f  draws %lld\n",
+			          percentile( 50), percentile( 95), percentile( 99), lastDrawCalls);
+			text += line;
+			snprintf( line, sizeof( line), "render %.2f ms  text %.2f ms  move %.3f ms (mean %.3f)\n",
+			          lastRender, lastTextDisplay, lastMove, moveCount > 0 ? moveTotal / moveCount : 0.0);
+			text += line;
+			snprintf( line, sizeof( line), "history %.1f KB for %d positions\n",
+			          historyBytes / 1024.0, historyLength);
+			text += line;
+			snprintf( line, sizeof( line), "first frame %.1f ms after start (window %.1f ms, font %.1f ms)",
+			          firstFrame, windowCreation, fontLoad);
+			text += line;
+			return text;
+		}
+
+	private:
+		double percentile( int percent)
+		{
+			int kept = std::min( frameCount, HudFramesKept);
+			if( kept == 0) {
+				return 0;
+			}
+			std::vector<double> sorted( frameTimes, frameTimes + kept);
+			size_t rank = std::min( (size_t) kept - 1, (size_t)( kept * percent / 100));
+			std::nth_element( sorted.begin(), sorted.begin() + rank, sorted.end());
+			return sorted[ rank];
+		}
+
+		bool isVisible;
+		double frameTimes[ HudFramesKept];   // Ring of the most recent frame times
+		int frameCount;
+		long long lastDrawCalls;
+		double lastRender;
+		double lastTextDisplay;
+		double lastMove;
+		long long moveCount;
+		double moveTotal;
+		double windowCreation;
+		double fontLoad;
+		double firstFrame;
+
+}; //end class PerformanceHud
+
+
 //this function is copy anything in the board and put it in previousBoard.
 void copyBoard(int board[], int previousBoard[], int squaresPerSide, int score){
     for ( int i = 0; i < squaresPerSide*squaresPerSide; i++){
@@ -322,14 +1298,13 @@ bool boardChanged(int board[],int previousBoard[],int squaresPerSide,int score){
 
 // make the goal for the board ( still not working)
 int boardGoal(int squaresPerSide){
-    int fomular;
-    return fomular = 1024*pow(2,abs(squaresPerSide-4));    
+    return ClassicRules::goal(squaresPerSide);
 }
 
 //this function is checking if the board got max goal or not.
 bool maxGoal(int board[],int squaresPerSide){
     int fomular;
-    fomular = 1024*pow(2,abs(squaresPerSide-4));
+    fomular = ClassicRules::goal(squaresPerSide);
     for ( int i = 0 ; i < squaresPerSide*squaresPerSide; i++){
         if( board[i] == fomular){
             return true;
@@ -339,7 +1314,7 @@ bool maxGoal(int board[],int squaresPerSide){
 }
 
 //make the move in the board
-void movePieces(int board[], char userInput,int &squaresPerSide, int &score, int &move, Node* &pHead){
+void movePieces(int board[], char userInput,int &squaresPerSide, int &score, int &move, Timeline &timeline){
     char destination;
     int number;
     int position;
@@ -349,7 +1324,7 @@ void movePieces(int board[], char userInput,int &squaresPerSide, int &score, int
         //when user press u to undo what the make.
         case 'U':
             std::cout << std::endl;
-            undoList( squaresPerSide, board, move, score, pHead);            
+            undoList( squaresPerSide, board, move, score, timeline);            
             break;
         //when user press X to quit and see the magic happend.
         case 'X':
@@ -396,19 +1371,10 @@ void movePieces(int board[], char userInput,int &squaresPerSide, int &score, int
             break;
         //when user press W to move pieces over.
         case 'W':
-            for( int j = 0; j < squaresPerSide; j++){
-                bool notMove = true;
-                for( int i = 0; i < squaresPerSide-1; i++){
-                    if((board[getIndex(i,j,squaresPerSide)] == 0)&&(board[getIndex(i+1,j,squaresPerSide)] !=0)){
-                        notMove = false;
-                        board[getIndex(i,j,squaresPerSide)] = board[getIndex(i+1,j,squaresPerSide)];
-                        board[getIndex(i+1,j,squaresPerSide)] = 0;
-                    }
-                }
-                if(notMove == false){
-                    j--;
-                }
-            }
+            //the columns are the rows of the transposed board, so moving up is moving them left.
+            transposeBoard(board, squaresPerSide);
+            movePieces(board, 'A', squaresPerSide, score, move, timeline);
+            transposeBoard(board, squaresPerSide);
             break;
         //when user press D to move pieces in the right.
         case 'D':
@@ -428,25 +1394,16 @@ void movePieces(int board[], char userInput,int &squaresPerSide, int &score, int
             break;
         //when user press S to move pieces down.
         case 'S':
-            for( int j = 0; j < squaresPerSide; j++){
-                bool notMove = true;
-                for( int i = squaresPerSide - 1; i > 0 ; i--){
-                    if((board[getIndex(i-1,j,squaresPerSide)] != 0)&&(board[getIndex(i,j,squaresPerSide)] == 0)){
-                        notMove = false;
-                        board[getIndex(i,j,squaresPerSide)] = board[getIndex(i-1,j,squaresPerSide)];
-                        board[getIndex(i-1,j,squaresPerSide)] = 0;
-                    }
-                }
-                if(notMove == false){
-                    j--;
-                }
-            }
+            //the columns are the rows of the transposed board, so moving down is moving them right.
+            transposeBoard(board, squaresPerSide);
+            movePieces(board, 'D', squaresPerSide, score, move, timeline);
+            transposeBoard(board, squaresPerSide);
             break;
     }
 }
 
 //make the combine near it if it's got the same value
-void combine(int board[], char userInput,int &squaresPerSide, int &score, int &move, Node* &pHead){
+void combine(int board[], char userInput,int &squaresPerSide, int &score, int &move, Timeline &timeline){
     switch (userInput){
         case 'A':
             for( int i = 0; i < squaresPerSide; i++){
@@ -456,25 +1413,17 @@ void combine(int board[], char userInput,int &squaresPerSide, int &score, int &m
                             board[getIndex(i,j,squaresPerSide)] *= 2;
                             board[getIndex(i,j+1,squaresPerSide)] = 0;
                             score += (board[getIndex(i,j,squaresPerSide)]);
-                            movePieces(board,userInput,squaresPerSide,score, move, pHead);
+                            movePieces(board,userInput,squaresPerSide,score, move, timeline);
                         }
                     }
                 }
             }
             break;
         case 'W':
-            for( int j = 0; j < squaresPerSide; j++){
-                for( int i = 0; i < squaresPerSide-1; i++){
-                    if((board[getIndex(i,j,squaresPerSide)] != 0)&&(board[getIndex(i+1,j,squaresPerSide)] != 0)){
-                        if(board[getIndex(i,j,squaresPerSide)] == (board[getIndex(i+1,j,squaresPerSide)])){
-                            board[getIndex(i,j,squaresPerSide)] *= 2;
-                            board[getIndex(i+1,j,squaresPerSide)] = 0;
-                            score += (board[getIndex(i,j,squaresPerSide)]);
-                            movePieces(board,userInput,squaresPerSide,score,move, pHead);
-                        }
-                    }
-                }
-            }
+            //combine the columns as the rows of the transposed board.
+            transposeBoard(board, squaresPerSide);
+            combine(board, 'A', squaresPerSide, score, move, timeline);
+            transposeBoard(board, squaresPerSide);
             break;
         case 'D':
             for( int i = 0; i < squaresPerSide ; i++){
@@ -484,67 +1433,4832 @@ void combine(int board[], char userInput,int &squaresPerSide, int &score, int &m
                             board[getIndex(i,j,squaresPerSide)] *= 2;
                             board[getIndex(i,j-1,squaresPerSide)] = 0;
                             score += board[getIndex(i,j,squaresPerSide)];
-                            movePieces(board,userInput,squaresPerSide,score,move, pHead);
+                            movePieces(board,userInput,squaresPerSide,score,move, timeline);
                         }
                     }
                 }
             }
             break;
         case 'S':
-            for( int j = 0; j < squaresPerSide; j++){
-                for( int i = squaresPerSide - 1; i > 0 ; i--){
-                    if((board[getIndex(i,j,squaresPerSide)] != 0)&&(board[getIndex(i-1,j,squaresPerSide)] != 0)){
-                        if(board[getIndex(i,j,squaresPerSide)] == board[getIndex(i-1,j,squaresPerSide)]){
-                            board[getIndex(i,j,squaresPerSide)] *= 2;
-                            board[getIndex(i-1,j,squaresPerSide)] = 0;
-                            score += board[getIndex(i,j,squaresPerSide)];
-                            movePieces(board,userInput,squaresPerSide,score,move, pHead);
-                        }
-                    }
+            //combine the columns as the rows of the transposed board.
+            transposeBoard(board, squaresPerSide);
+            combine(board, 'D', squaresPerSide, score, move, timeline);
+            transposeBoard(board, squaresPerSide);
+            break;
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Fast move kernel for boards of any size.
+// Slide one line of tiles towards its start (index 0): tiles are pushed together, then
+// neighboring tiles that the rules let combine are combined from the start of the line
+// onwards, each tile at most once per move.  With the classic rules this gives the same
+// result as movePieces() followed by combine().
+// Returns true if anything moved, and adds the value of combined tiles to score.
+template <typename Rules = ClassicRules>
+bool slideLine( int line[], int length, int &score)
+{
+    int result[ MaxBoardSize];
+    int count = 0;
+    int pending = 0;   // Tile waiting to see if the next tile combines with it
+    for( int i = 0; i < length; i++) {
+        if( line[ i] == 0) {
+            continue;
+        }
+        if( pending != 0 && Rules::canMerge( pending, line[ i])) {
+            result[ count++] = pending + line[ i];
+            score += pending + line[ i];
+            pending = 0;
+        }
+        else {
+            if( pending != 0) {
+                result[ count++] = pending;
+            }
+            pending = line[ i];
+        }
+    }
+    if( pending != 0) {
+        result[ count++] = pending;
+    }
+
+    bool changed = false;
+    for( int i = 0; i < length; i++) {
+        int value = (i < count) ? result[ i] : 0;
+        changed |= (line[ i] != value);
+        line[ i] = value;
+    }
+    return changed;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Slide one line of tiles towards its end (index length-1), the mirror image of slideLine().
+template <typename Rules = ClassicRules>
+bool slideLineToEnd( int line[], int length, int &score)
+{
+    int result[ MaxBoardSize];
+    int count = 0;
+    int pending = 0;
+    for( int i = length - 1; i >= 0; i--) {
+        if( line[ i] == 0) {
+            continue;
+        }
+        if( pending != 0 && Rules::canMerge( pending, line[ i])) {
+            result[ count++] = pending + line[ i];
+            score += pending + line[ i];
+            pending = 0;
+        }
+        else {
+            if( pending != 0) {
+                result[ count++] = pending;
+            }
+            pending = line[ i];
+        }
+    }
+    if( pending != 0) {
+        result[ count++] = pending;
+    }
+
+    bool changed = false;
+    for( int i = 0; i < length; i++) {
+        int value = (i < count) ? result[ i] : 0;
+        changed |= (line[ length - 1 - i] != value);
+        line[ length - 1 - i] = value;
+    }
+    return changed;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Packed 4x4 boards, used for training and evaluating the AI.
+// A 4x4 board is packed into 64 bits holding one 4-bit tile exponent per square (0 for an
+// empty square, 1 for a 2, 2 for a 4, ... 15 for 32768), with square 0 in the low 4 bits.
+// Each row of the board is then a 16-bit value, so the result of sliding every possible
+// row can be computed once up front and looked up in a table afterwards.
+typedef uint64_t PackedBoard;
+
+const int PackedSide = 4;
+const int RowTableSize = 65536;          // One entry for every possible 16-bit row
+unsigned short rowLeftTable[ RowTableSize];    // Row after moving left ('A')
+unsigned short rowRightTable[ RowTableSize];   // Row after moving right ('D')
+int rowScoreTable[ RowTableSize];              // Points scored by the row in either direction
+
+
+//---------------------------------------------------------------------------------------
+// Convert between a regular board of tile values and a packed 4x4 board of exponents.
+PackedBoard packBoard( int board[])
+{
+    PackedBoard packed = 0;
+    for( int i = 0; i < PackedSide * PackedSide; i++) {
+        int exponent = 0;
+        for( int value = board[ i]; value > 1; value /= 2) {
+            exponent++;
+        }
+        packed |= (PackedBoard) exponent << (4 * i);
+    }
+    return packed;
+}
+
+// True if every tile can be packed and moved: empty, or a power of two up to 16384, so that
+// a merge still fits in 4 bits.  The game's 'p' command can put any value on the board.
+bool fitsPacked( int board[])
+{
+    for( int i = 0; i < PackedSide * PackedSide; i++) {
+        if( board[ i] < 0 || board[ i] == 1 || board[ i] > 16384 || (board[ i] & (board[ i] - 1)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void unpackBoard( PackedBoard packed, int board[])
+{
+    for( int i = 0; i < PackedSide * PackedSide; i++) {
+        int exponent = (packed >> (4 * i)) & 0xF;
+        board[ i] = (exponent == 0) ? 0 : (1 << exponent);
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Build the row tables.  Each row is slid with slideLine(), which follows exactly the same
+// rules as movePieces() and combine() in the interactive game; moving a whole scratch board
+// with those for every row took most of the program's startup time.  Tiles are capped at
+// 32768 (exponent 15) so the result still fits in 4 bits.
+void initializeMoveTables()
+{
+    int scratch[ PackedSide];
+
+    for( int row = 0; row < RowTableSize; row++) {
+        int score = 0;
+        int result[ 2];
+        for( int d = 0; d < 2; d++) {
+            for( int j = 0; j < PackedSide; j++) {
+                int exponent = (row >> (4 * j)) & 0xF;
+                scratch[ j] = (exponent == 0) ? 0 : (1 << exponent);
+            }
+            score = 0;
+            if( d == 0) {
+                slideLine( scratch, PackedSide, score);
+            }
+            else {
+                slideLineToEnd( scratch, PackedSide, score);
+            }
+
+            result[ d] = 0;
+            for( int j = 0; j < PackedSide; j++) {
+                int exponent = 0;
+                for( int value = scratch[ j]; value > 1; value /= 2) {
+                    exponent++;
+                }
+                if( exponent > 15) {
+                    exponent = 15;
+                }
+                result[ d] |= exponent << (4 * j);
+            }
+        }
+        rowLeftTable[ row] = result[ 0];
+        rowRightTable[ row] = result[ 1];
+        rowScoreTable[ row] = score;
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Swap rows and columns of a packed board, so that 'W' and 'S' can use the row tables.
+PackedBoard transposePacked( PackedBoard x)
+{
+    PackedBoard a1 = x & 0xF0F00F0FF0F00F0FULL;
+    PackedBoard a2 = x & 0x0000F0F00000F0F0ULL;
+    PackedBoard a3 = x & 0x0F0F00000F0F0000ULL;
+    PackedBoard a = a1 | (a2 << 12) | (a3 >> 12);
+    PackedBoard b1 = a & 0xFF00FF0000FF00FFULL;
+    PackedBoard b2 = a & 0x00FF00FF00000000ULL;
+    PackedBoard b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+
+//---------------------------------------------------------------------------------------
+// Make a move on a packed board, returning the new board and adding to score the value of
+// any tiles that were combined.  The board is returned unchanged when the move is not possible.
+PackedBoard executePackedMove( PackedBoard packed, char direction, int &score)
+{
+    bool vertical = (direction == 'W' || direction == 'S');
+    bool towardsStart = (direction == 'A' || direction == 'W');
+    PackedBoard rows = vertical ? transposePacked( packed) : packed;
+    PackedBoard result = 0;
+
+    for( int i = 0; i < PackedSide; i++) {
+        int row = (rows >> (16 * i)) & 0xFFFF;
+        int newRow = towardsStart ? rowLeftTable[ row] : rowRightTable[ row];
+        score += rowScoreTable[ row];   // Merging from either end gives the same points
+        result |= (PackedBoard) newRow << (16 * i);
+    }
+    return vertical ? transposePacked( result) : result;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Small, fast random number generator (xorshift64*).  Each thread owns its own, since
+// rand() shares one hidden state between all threads.
+struct FastRandom {
+    uint64_t state;
+
+    FastRandom( uint64_t seed = 88172645463325252ULL) { state = seed ? seed : 1; }
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ULL;
+    }
+    // Random number in the range 0..limit-1
+    int nextInt( int limit) { return (int)((next() >> 33) % limit); }
+};
+
+
+//---------------------------------------------------------------------------------------
+// Count the empty squares of a packed board.
+int countEmptyPacked( PackedBoard packed)
+{
+    int count = 0;
+    for( int i = 0; i < PackedSide * PackedSide; i++) {
+        if( ((packed >> (4 * i)) & 0xF) == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Same rules as placeRandomPiece(): a 2 or a 4 with equal chance, in a random empty square.
+PackedBoard placeRandomPacked( PackedBoard packed, FastRandom &random)
+{
+    int emptyCount = countEmptyPacked( packed);
+    if( emptyCount == 0) {
+        return packed;
+    }
+    PackedBoard exponent = (random.nextInt( 2) == 1) ? 2 : 1;
+    int target = random.nextInt( emptyCount);
+    for( int i = 0; i < PackedSide * PackedSide; i++) {
+        if( ((packed >> (4 * i)) & 0xF) == 0) {
+            if( target == 0) {
+                return packed | (exponent << (4 * i));
+            }
+            target--;
+        }
+    }
+    return packed;
+}
+
+
+//---------------------------------------------------------------------------------------
+// N-tuple network used to evaluate a packed board.
+// Each tuple is a group of 4 squares (the 4 rows, the 4 columns and the 9 2x2 blocks).
+// The 4 exponents in a tuple form a 16-bit index into that tuple's own table of weights,
+// and the value of a board is the sum of the weights selected by all of its tuples.
+const int TupleCount = 17;
+const int TupleLength = 4;
+const int TupleTableSize = 65536;
+
+const int tupleSquares[ TupleCount][ TupleLength] = {
+    { 0, 1, 2, 3}, { 4, 5, 6, 7}, { 8, 9,10,11}, {12,13,14,15},      // rows
+    { 0, 4, 8,12}, { 1, 5, 9,13}, { 2, 6,10,14}, { 3, 7,11,15},      // columns
+    { 0, 1, 4, 5}, { 1, 2, 5, 6}, { 2, 3, 6, 7},                     // 2x2 blocks
+    { 4, 5, 8, 9}, { 5, 6, 9,10}, { 6, 7,10,11},
+    { 8, 9,12,13}, { 9,10,13,14}, {10,11,14,15}
+};
+
+// Weights are shared by all training threads without locks ("Hogwild" updates).  They are
+// atomic only so that concurrent reads and writes are well defined; relaxed loads and
+// stores compile to plain moves, and an occasional lost update does not hurt training.
+std::atomic<float> *tupleWeights = NULL;
+
+
+//---------------------------------------------------------------------------------------
+// Allocate the weight tables, all starting at 0.
+void initializeTupleWeights()
+{
+    if( tupleWeights == NULL) {
+        tupleWeights = new std::atomic<float>[ TupleCount * TupleTableSize]();
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Find where each tuple's weight is stored for this board.
+void tupleIndices( PackedBoard packed, int indices[])
+{
+    for( int t = 0; t < TupleCount; t++) {
+        int index = 0;
+        for( int k = 0; k < TupleLength; k++) {
+            index |= ((packed >> (4 * tupleSquares[ t][ k])) & 0xF) << (4 * k);
+        }
+        indices[ t] = t * TupleTableSize + index;
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Value of a board according to the n-tuple network.
+float evaluateTuples( PackedBoard packed)
+{
+    int indices[ TupleCount];
+    tupleIndices( packed, indices);
+    float value = 0;
+    for( int t = 0; t < TupleCount; t++) {
+        value += tupleWeights[ indices[ t]].load( std::memory_order_relaxed);
+    }
+    return value;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Move every tuple weight of a board by the same amount.
+void updateTuples( PackedBoard packed, float delta)
+{
+    int indices[ TupleCount];
+    tupleIndices( packed, indices);
+    for( int t = 0; t < TupleCount; t++) {
+        std::atomic<float> &weight = tupleWeights[ indices[ t]];
+        weight.store( weight.load( std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Choose the move whose resulting board (before the random piece is placed) has the best
+// points plus network value.  Returns ' ' when no move changes the board.
+char chooseTupleMove( PackedBoard packed, PackedBoard &bestAfter, int &bestPoints)
+{
+    const char directions[ 4] = { 'W', 'A', 'S', 'D'};
+    char bestDirection = ' ';
+    float bestValue = 0;
+    for( int d = 0; d < 4; d++) {
+        int points = 0;
+        PackedBoard after = executePackedMove( packed, directions[ d], points);
+        if( after == packed) {
+            continue;
+        }
+        float value = points + evaluateTuples( after);
+        if( bestDirection == ' ' || value > bestValue) {
+            bestDirection = directions[ d];
+            bestValue = value;
+            bestAfter = after;
+            bestPoints = points;
+        }
+    }
+    return bestDirection;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Save the weights to a binary checkpoint file, or load them back.  The file holds a short
+// header (tag, tuple count, table size) followed by the raw float weights.
+const char WeightsFileTag[ 8] = { 'T','U','P','L','E','S','0','1'};
+
+bool saveTupleWeights( const char *fileName)
+{
+    // Write to a temporary file first, so an interrupted save never destroys the old checkpoint
+    std::string tempName = std::string( fileName) + ".tmp";
+    FILE *pFile = fopen( tempName.c_str(), "wb");
+    if( pFile == NULL) {
+        return false;
+    }
+    int header[ 2] = { TupleCount, TupleTableSize};
+    fwrite( WeightsFileTag, 1, sizeof( WeightsFileTag), pFile);
+    fwrite( header, sizeof( int), 2, pFile);
+    std::vector<float> buffer( TupleTableSize);
+    for( int t = 0; t < TupleCount; t++) {
+        for( int i = 0; i < TupleTableSize; i++) {
+            buffer[ i] = tupleWeights[ t * TupleTableSize + i].load( std::memory_order_relaxed);
+        }
+        fwrite( &buffer[ 0], sizeof( float), TupleTableSize, pFile);
+    }
+    bool ok = (fclose( pFile) == 0);
+    return ok && rename( tempName.c_str(), fileName) == 0;
+}
+
+bool loadTupleWeights( const char *fileName)
+{
+    FILE *pFile = fopen( fileName, "rb");
+    if( pFile == NULL) {
+        return false;
+    }
+    char tag[ 8];
+    int header[ 2];
+    bool ok = fread( tag, 1, sizeof( tag), pFile) == sizeof( tag)
+           && memcmp( tag, WeightsFileTag, sizeof( tag)) == 0
+           && fread( header, sizeof( int), 2, pFile) == 2
+           && header[ 0] == TupleCount && header[ 1] == TupleTableSize;
+    std::vector<float> buffer( TupleTableSize);
+    for( int t = 0; ok && t < TupleCount; t++) {
+        ok = fread( &buffer[ 0], sizeof( float), TupleTableSize, pFile) == (size_t) TupleTableSize;
+        for( int i = 0; ok && i < TupleTableSize; i++) {
+            tupleWeights[ t * TupleTableSize + i].store( buffer[ i], std::memory_order_relaxed);
+        }
+    }
+    fclose( pFile);
+    return ok;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Kernel dispatch.
+// The hottest loops (moving rows, checking for game over, scoring a board) come in several
+// versions, one per instruction set level.  The program is built for the plain x86-64
+// baseline so it runs on every machine we have; at startup it asks the processor what it
+// supports and points the table below at the best version of each kernel.  A lower level
+// can be forced with --simd=<level>, for benchmarking.
+enum SimdLevel { SimdScalar, SimdSse42, SimdAvx2, SimdAvx512, SimdLevelCount };
+const char *simdLevelNames[ SimdLevelCount] = { "scalar", "sse4.2", "avx2", "avx512"};
+
+// Slide rowCount rows of tile exponents towards their start (or end), adding the points of
+// combined tiles to score and setting changed if any row changed.
+typedef void (*RowsKernel)( unsigned char rows[], int rowCount, int length, bool towardsStart,
+                            long long &score, bool &changed);
+// True if some move can still change a board of tile exponents.
+typedef bool (*CanMoveKernel)( const unsigned char exponents[], int squaresPerSide);
+// Heuristic score of a board of tile exponents.
+typedef int (*EvaluateKernel)( const unsigned char exponents[], int squaresPerSide);
+
+struct KernelTable {
+    SimdLevel level;                 // Best level the processor supports, or the forced level
+    SimdLevel detectedLevel;         // Best level the processor supports
+    RowsKernel slideRows;
+    const char *slideRowsName;
+    CanMoveKernel canMove;
+    const char *canMoveName;
+    EvaluateKernel evaluate;
+    const char *evaluateName;
+};
+KernelTable activeKernels;   // Filled in by initializeKernels()
+
+
+//---------------------------------------------------------------------------------------
+// Heuristic evaluation, a lighter-weight alternative to the trained n-tuple network.
+// Every row and every column of the board is scored on its own, as the sum of:
+//    - empty squares, which leave room to keep playing
+//    - neighboring equal tiles, which can be combined on a later move
+//    - monotonicity, a penalty for lines that go both up and down in value
+//    - smoothness, a penalty for large jumps in value between neighbors
+//    - corner weighting, a bonus for keeping big tiles at the ends of the line
+// All terms use tile exponents and whole numbers, so every way of computing the score
+// (table lookup or full scan) gives exactly the same answer.
+const int EmptyWeight = 270;
+const int MergeWeight = 700;
+const int MonotonicityWeight = 47;
+const int SmoothnessWeight = 20;
+const int CornerWeight = 10;
+
+int heuristicRowTable[ RowTableSize];   // Score of each possible packed 4x4 row
+
+
+//---------------------------------------------------------------------------------------
+// Score one line of tile exponents.
+int heuristicLine( const unsigned char exponents[], int length)
+{
+    int empty = 0;
+    int merges = 0;
+    int increasing = 0;
+    int decreasing = 0;
+    int roughness = 0;
+    for( int i = 0; i < length; i++) {
+        empty += (exponents[ i] == 0);
+    }
+    for( int i = 0; i < length - 1; i++) {
+        int current = exponents[ i];
+        int next = exponents[ i + 1];
+        merges += (current != 0 && current == next);
+        increasing += std::max( 0, next * next - current * current);
+        decreasing += std::max( 0, current * current - next * next);
+        roughness += std::abs( current - next);
+    }
+    int first = exponents[ 0];
+    int last = exponents[ length - 1];
+    return EmptyWeight * empty + MergeWeight * merges
+         - MonotonicityWeight * std::min( increasing, decreasing)
+         - SmoothnessWeight * roughness
+         + CornerWeight * (first * first + last * last);
+}
+
+
+//---------------------------------------------------------------------------------------
+// Precompute the score of every possible 4x4 row.
+void initializeHeuristicTable()
+{
+    unsigned char exponents[ PackedSide];
+    for( int row = 0; row < RowTableSize; row++) {
+        for( int j = 0; j < PackedSide; j++) {
+            exponents[ j] = (row >> (4 * j)) & 0xF;
+        }
+        heuristicRowTable[ row] = heuristicLine( exponents, PackedSide);
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Heuristic score of a packed 4x4 board: 4 row lookups plus 4 column lookups.
+int evaluateHeuristicPacked( PackedBoard packed)
+{
+    PackedBoard columns = transposePacked( packed);
+    return heuristicRowTable[ packed & 0xFFFF] + heuristicRowTable[ (packed >> 16) & 0xFFFF]
+         + heuristicRowTable[ (packed >> 32) & 0xFFFF] + heuristicRowTable[ packed >> 48]
+         + heuristicRowTable[ columns & 0xFFFF] + heuristicRowTable[ (columns >> 16) & 0xFFFF]
+         + heuristicRowTable[ (columns >> 32) & 0xFFFF] + heuristicRowTable[ columns >> 48];
+}
+
+
+//---------------------------------------------------------------------------------------
+// Heuristic score of a board of any size, given as an array of tile exponents.
+// Gives the same result as heuristicLine() on every row and column, but is written as
+// straight-line loops over neighboring squares without branches, so that the compiler can
+// process many squares at once with vector instructions.  The column terms walk two
+// neighboring rows side by side, so they stay contiguous in memory as well.
+// The body is compiled once per instruction set level (see the evaluate kernels).
+inline __attribute__(( always_inline))
+int evaluateHeuristicScanBody( const unsigned char exponents[], int squaresPerSide)
+{
+    int n = squaresPerSide;
+    int total = 0;
+    int increasing[ MaxBoardSize];
+    int decreasing[ MaxBoardSize];
+
+    // Empty squares are counted once for the rows and once for the columns
+    int empty = 0;
+    for( int i = 0; i < n * n; i++) {
+        empty += (exponents[ i] == 0);
+    }
+    total += 2 * EmptyWeight * empty;
+
+    // Rows
+    for( int i = 0; i < n; i++) {
+        const unsigned char *row = &exponents[ i * n];
+        int merges = 0, up = 0, down = 0, roughness = 0;
+        for( int j = 0; j < n - 1; j++) {
+            int current = row[ j];
+            int next = row[ j + 1];
+            merges += (current != 0) & (current == next);
+            up += std::max( 0, next * next - current * current);
+            down += std::max( 0, current * current - next * next);
+            roughness += std::abs( current - next);
+        }
+        total += MergeWeight * merges - MonotonicityWeight * std::min( up, down)
+               - SmoothnessWeight * roughness
+               + CornerWeight * (row[ 0] * row[ 0] + row[ n - 1] * row[ n - 1]);
+    }
+
+    // Columns, comparing each row with the one below it
+    for( int j = 0; j < n; j++) {
+        increasing[ j] = 0;
+        decreasing[ j] = 0;
+    }
+    int merges = 0, roughness = 0;
+    for( int i = 0; i < n - 1; i++) {
+        const unsigned char *row = &exponents[ i * n];
+        const unsigned char *below = &exponents[ (i + 1) * n];
+        for( int j = 0; j < n; j++) {
+            int current = row[ j];
+            int next = below[ j];
+            merges += (current != 0) & (current == next);
+            increasing[ j] += std::max( 0, next * next - current * current);
+            decreasing[ j] += std::max( 0, current * current - next * next);
+            roughness += std::abs( current - next);
+        }
+    }
+    const unsigned char *top = &exponents[ 0];
+    const unsigned char *bottom = &exponents[ (n - 1) * n];
+    int monotonicity = 0, corners = 0;
+    for( int j = 0; j < n; j++) {
+        monotonicity += std::min( increasing[ j], decreasing[ j]);
+        corners += top[ j] * top[ j] + bottom[ j] * bottom[ j];
+    }
+    total += MergeWeight * merges - MonotonicityWeight * monotonicity
+           - SmoothnessWeight * roughness + CornerWeight * corners;
+    return total;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Convert a board of tile values to tile exponents (0 for empty, 1 for 2, 2 for 4, ...).
+void boardToExponents( int board[], unsigned char exponents[], int squaresPerSide)
+{
+    for( int i = 0; i < squaresPerSide * squaresPerSide; i++) {
+        exponents[ i] = (board[ i] == 0) ? 0 : __builtin_ctz( board[ i]);
+    }
+}
+
+// True if every tile has an exponent: empty, or a power of two from 2 up.  The game's 'p'
+// command can put any value on the board, and a 3 or a 6 would be read as the wrong tile.
+bool fitsExponents( int board[], int squaresPerSide)
+{
+    for( int i = 0; i < squaresPerSide * squaresPerSide; i++) {
+        if( board[ i] < 0 || board[ i] == 1 || (board[ i] & (board[ i] - 1)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Heuristic score of a regular board, using the tables for a 4x4 board that fits in them and
+// the scan otherwise.
+int evaluateHeuristic( int board[], int squaresPerSide)
+{
+    if( squaresPerSide == PackedSide && fitsPacked( board)) {
+        return evaluateHeuristicPacked( packBoard( board));
+    }
+    unsigned char exponents[ MaxBoardSize * MaxBoardSize];
+    boardToExponents( board, exponents, squaresPerSide);
+    return activeKernels.evaluate( exponents, squaresPerSide);
+}
+
+
+//---------------------------------------------------------------------------------------
+// Make a move on a board of any size without the extra checks of movePieces(), returning
+// true if the board changed.  Every row is slid in place where it sits in memory; for 'W'
+// and 'S' the board is transposed first so that its columns become rows as well.
+template <typename Rules = ClassicRules>
+bool makeFastMove( int board[], char direction, int squaresPerSide, int &score)
+{
+    int n = squaresPerSide;
+    bool vertical = (direction == 'W' || direction == 'S');
+    bool towardsStart = (direction == 'A' || direction == 'W');
+    if( !vertical && direction != 'A' && direction != 'D') {
+        return false;
+    }
+    if( vertical) {
+        transposeBoard( board, n);
+    }
+    bool changed = false;
+    for( int k = 0; k < n; k++) {
+        int *row = &board[ k * n];
+        changed |= towardsStart ? slideLine<Rules>( row, n, score) : slideLineToEnd<Rules>( row, n, score);
+    }
+    if( vertical) {
+        transposeBoard( board, n);
+    }
+    return changed;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Same rules as placeRandomPiece(), but using the caller's random number generator and
+// picking among the open squares directly.  Returns false if there were no open squares.
+template <typename Rules = ClassicRules>
+bool placeRandomFast( int board[], int squaresPerSide, FastRandom &random)
+{
+    int emptyCount = 0;
+    for( int i = 0; i < squaresPerSide * squaresPerSide; i++) {
+        emptyCount += (board[ i] == 0);
+    }
+    if( emptyCount == 0) {
+        return false;
+    }
+    int pieceToPlace = Rules::spawnValue( random.nextInt( Rules::SpawnOutOf));
+    int target = random.nextInt( emptyCount);
+    for( int i = 0; ; i++) {
+        if( board[ i] == 0 && target-- == 0) {
+            board[ i] = pieceToPlace;
+            return true;
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Row kernels on tile exponents.
+// Boards wider than 4 cannot use a lookup table per row (a 12-wide row has 2^48 possible
+// values), so for those the row is processed with SIMD instructions instead.  A row is held
+// one exponent per byte, up to 16 bytes in one SSE register:
+//    1. compact: a shuffle mask, looked up from the bit mask of non-empty squares, moves
+//       all tiles to the start of the register in order
+//    2. pairs: comparing the register with itself shifted by one square finds equal
+//       neighbors; a second table picks which of them combine (in a run of three equal
+//       tiles only the first two combine)
+//    3. merge: combining tiles get 1 added to their exponent, their partners are cleared
+//    4. compact again
+// The AVX2 version does the same to two rows at once, one in each 128-bit half.  A plain
+// C++ version is always available, and the fastest one the processor supports is chosen
+// when the program starts (see initializeKernels()).
+// All versions slide a row towards its start, adding the points of combined tiles to score
+// and returning true if the row changed.
+const int SimdRowLimit = 12;   // Widest row the SIMD kernels handle (bit mask tables are 2^12)
+
+unsigned char compactTable[ 1 << SimdRowLimit][ 16];   // Shuffle mask for each non-empty mask
+unsigned short mergeTable[ 1 << SimdRowLimit];         // Combining squares for each equal-pair mask
+
+
+//---------------------------------------------------------------------------------------
+// Plain C++ version, for any length of row.
+bool slideExponentRowScalar( unsigned char row[], int length, long long &score)
+{
+    int count = 0;
+    int pending = 0;
+    bool changed = false;
+    for( int i = 0; i < length; i++) {
+        int exponent = row[ i];
+        if( exponent == 0) {
+            continue;
+        }
+        if( pending == exponent) {
+            changed |= (row[ count] != exponent + 1);
+            row[ count++] = exponent + 1;
+            score += 2LL << exponent;
+            pending = 0;
+        }
+        else {
+            if( pending != 0) {
+                changed |= (row[ count] != pending);
+                row[ count++] = pending;
+            }
+            pending = exponent;
+        }
+    }
+    if( pending != 0) {
+        changed |= (row[ count] != pending);
+        row[ count++] = pending;
+    }
+    for( int i = count; i < length; i++) {
+        changed |= (row[ i] != 0);
+        row[ i] = 0;
+    }
+    return changed;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Plain C++ version for a block of rows, in either direction.
+void slideExponentRowsScalar( unsigned char rows[], int rowCount, int length, bool towardsStart,
+                              long long &score, bool &changed)
+{
+    for( int k = 0; k < rowCount; k++) {
+        unsigned char *row = &rows[ (size_t) k * length];
+        if( towardsStart) {
+            changed |= slideExponentRowScalar( row, length, score);
+        }
+        else {
+            std::reverse( row, row + length);
+            changed |= slideExponentRowScalar( row, length, score);
+            std::reverse( row, row + length);
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Build the shuffle and combine tables used by the SIMD kernels.
+void initializeSimdTables()
+{
+    for( int mask = 0; mask < (1 << SimdRowLimit); mask++) {
+        int count = 0;
+        for( int i = 0; i < SimdRowLimit; i++) {
+            if( mask & (1 << i)) {
+                compactTable[ mask][ count++] = i;
+            }
+        }
+        while( count < 16) {
+            compactTable[ mask][ count++] = 0x80;   // Shuffle index with the top bit set gives 0
+        }
+
+        // Walk each run of equal pairs, taking every other pair starting with the first
+        int pairs = mask;
+        int merges = 0;
+        while( pairs != 0) {
+            int lowest = pairs & -pairs;
+            merges |= lowest;
+            pairs &= ~(lowest | (lowest << 1));
+        }
+        mergeTable[ mask] = merges;
+    }
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+//---------------------------------------------------------------------------------------
+// Turn the low 16 bits of a mask into a register with 0xFF in each byte whose bit is set.
+__attribute__(( target( "ssse3")))
+__m128i expandMask( int mask)
+{
+    const __m128i bitOfByte = _mm_setr_epi8( 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i byteOfMask = _mm_setr_epi8( 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    __m128i spread = _mm_shuffle_epi8( _mm_cvtsi32_si128( mask), byteOfMask);
+    return _mm_cmpeq_epi8( _mm_and_si128( spread, bitOfByte), bitOfByte);
+}
+
+
+//---------------------------------------------------------------------------------------
+// Slide one row held in a register towards its start.  lengthMask has one bit per square.
+__attribute__(( target( "ssse3")))
+__m128i slideRegister( __m128i row, int lengthMask, long long &score)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int present = ~_mm_movemask_epi8( _mm_cmpeq_epi8( row, zero)) & lengthMask;
+    __m128i tiles = _mm_shuffle_epi8( row, _mm_loadu_si128( (const __m128i *) compactTable[ present]));
+
+    __m128i next = _mm_srli_si128( tiles, 1);
+    int pairs = _mm_movemask_epi8( _mm_andnot_si128( _mm_cmpeq_epi8( tiles, zero), _mm_cmpeq_epi8( tiles, next)))
+              & (lengthMask >> 1);
+    if( pairs == 0) {
+        return tiles;
+    }
+    int merges = mergeTable[ pairs];
+    for( int bits = merges; bits != 0; bits &= bits - 1) {
+        unsigned char exponents[ 16];
+        _mm_storeu_si128( (__m128i *) exponents, tiles);
+        score += 2LL << exponents[ __builtin_ctz( bits)];
+    }
+    tiles = _mm_sub_epi8( tiles, expandMask( merges));         // 0xFF is -1, so this adds 1
+    tiles = _mm_andnot_si128( expandMask( merges << 1), tiles);
+    present = ~_mm_movemask_epi8( _mm_cmpeq_epi8( tiles, zero)) & lengthMask;
+    return _mm_shuffle_epi8( tiles, _mm_loadu_si128( (const __m128i *) compactTable[ present]));
+}
+
+
+//---------------------------------------------------------------------------------------
+// Shuffle mask that reverses the first length bytes of a register, for sliding towards the end.
+__attribute__(( target( "ssse3")))
+__m128i reverseMask( int length)
+{
+    unsigned char indices[ 16];
+    for( int i = 0; i < 16; i++) {
+        indices[ i] = (i < length) ? length - 1 - i : 0x80;
+    }
+    return _mm_loadu_si128( (const __m128i *) indices);
+}
+
+
+//---------------------------------------------------------------------------------------
+// SSSE3 version: one row per register.
+__attribute__(( target( "ssse3")))
+void slideExponentRowsSsse3( unsigned char rows[], int rowCount, int length, bool towardsStart,
+                             long long &score, bool &changed)
+{
+    if( length > SimdRowLimit) {
+        slideExponentRowsScalar( rows, rowCount, length, towardsStart, score, changed);
+        return;
+    }
+    int lengthMask = (1 << length) - 1;
+    __m128i reverse = reverseMask( length);
+    for( int k = 0; k < rowCount; k++) {
+        unsigned char *row = &rows[ (size_t) k * length];
+        unsigned char buffer[ 16] = { 0};
+        memcpy( buffer, row, length);   // Rows are not padded, so never load past the end
+        __m128i before = _mm_loadu_si128( (const __m128i *) buffer);
+        __m128i after;
+        if( towardsStart) {
+            after = slideRegister( before, lengthMask, score);
+        }
+        else {
+            after = _mm_shuffle_epi8( slideRegister( _mm_shuffle_epi8( before, reverse), lengthMask, score), reverse);
+        }
+        if( _mm_movemask_epi8( _mm_cmpeq_epi8( before, after)) != 0xFFFF) {
+            changed = true;
+            _mm_storeu_si128( (__m128i *) buffer, after);
+            memcpy( row, buffer, length);
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// AVX2 version: two rows per register, one in each 128-bit half.  The AVX2 byte shuffle
+// works within each half, so the two rows never mix.
+__attribute__(( target( "avx2")))
+void slideExponentRowsAvx2( unsigned char rows[], int rowCount, int length, bool towardsStart,
+                            long long &score, bool &changed)
+{
+    if( length > SimdRowLimit) {
+        slideExponentRowsScalar( rows, rowCount, length, towardsStart, score, changed);
+        return;
+    }
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bitOfByte = _mm256_setr_epi8( 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                                1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i byteOfMask = _mm256_setr_epi8( 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                                 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    int lengthMask = (1 << length) - 1;
+    __m128i reverse128 = reverseMask( length);
+    __m256i reverse = _mm256_inserti128_si256( _mm256_castsi128_si256( reverse128), reverse128, 1);
+
+    int k = 0;
+    for( ; k + 1 < rowCount; k += 2) {
+        unsigned char *first = &rows[ (size_t) k * length];
+        unsigned char *second = first + length;
+        unsigned char buffer[ 32] = { 0};
+        memcpy( buffer, first, length);
+        memcpy( buffer + 16, second, length);
+        __m256i before = _mm256_loadu_si256( (const __m256i *) buffer);
+        __m256i tiles = towardsStart ? before : _mm256_shuffle_epi8( before, reverse);
+
+        // Compact both halves
+        unsigned present = ~(unsigned) _mm256_movemask_epi8( _mm256_cmpeq_epi8( tiles, zero));
+        __m256i shuffle = _mm256_inserti128_si256( _mm256_castsi128_si256(
+                              _mm_loadu_si128( (const __m128i *) compactTable[ present & lengthMask])),
+                              _mm_loadu_si128( (const __m128i *) compactTable[ (present >> 16) & lengthMask]), 1);
+        tiles = _mm256_shuffle_epi8( tiles, shuffle);
+
+        // Find and combine equal pairs in both halves
+        __m256i next = _mm256_srli_si256( tiles, 1);   // Shifts each half separately
+        unsigned pairs = _mm256_movemask_epi8( _mm256_andnot_si256( _mm256_cmpeq_epi8( tiles, zero),
+                                                                    _mm256_cmpeq_epi8( tiles, next)));
+        int pairsLow = pairs & (lengthMask >> 1);
+        int pairsHigh = (pairs >> 16) & (lengthMask >> 1);
+        if( (pairsLow | pairsHigh) != 0) {
+            unsigned merges = mergeTable[ pairsLow] | ((unsigned) mergeTable[ pairsHigh] << 16);
+            unsigned char exponents[ 32];
+            _mm256_storeu_si256( (__m256i *) exponents, tiles);
+            for( unsigned bits = merges; bits != 0; bits &= bits - 1) {
+                score += 2LL << exponents[ __builtin_ctz( bits)];
+            }
+            __m256i spread = _mm256_shuffle_epi8( _mm256_set1_epi32( merges), byteOfMask);
+            __m256i mergeBytes = _mm256_cmpeq_epi8( _mm256_and_si256( spread, bitOfByte), bitOfByte);
+            spread = _mm256_shuffle_epi8( _mm256_set1_epi32( merges << 1), byteOfMask);
+            __m256i clearBytes = _mm256_cmpeq_epi8( _mm256_and_si256( spread, bitOfByte), bitOfByte);
+            tiles = _mm256_andnot_si256( clearBytes, _mm256_sub_epi8( tiles, mergeBytes));
+
+            present = ~(unsigned) _mm256_movemask_epi8( _mm256_cmpeq_epi8( tiles, zero));
+            shuffle = _mm256_inserti128_si256( _mm256_castsi128_si256(
+                          _mm_loadu_si128( (const __m128i *) compactTable[ present & lengthMask])),
+                          _mm_loadu_si128( (const __m128i *) compactTable[ (present >> 16) & lengthMask]), 1);
+            tiles = _mm256_shuffle_epi8( tiles, shuffle);
+        }
+
+        __m256i after = towardsStart ? tiles : _mm256_shuffle_epi8( tiles, reverse);
+        if( (unsigned) _mm256_movemask_epi8( _mm256_cmpeq_epi8( before, after)) != 0xFFFFFFFFu) {
+            changed = true;
+            _mm256_storeu_si256( (__m256i *) buffer, after);
+            memcpy( first, buffer, length);
+            memcpy( second, buffer + 16, length);
+        }
+    }
+    if( k < rowCount) {
+        slideExponentRowsSsse3( &rows[ (size_t) k * length], 1, length, towardsStart, score, changed);
+    }
+}
+#endif
+
+
+//---------------------------------------------------------------------------------------
+// Game-over check: a move is possible if there is an empty square, or two equal tiles next
+// to each other across a row or down a column.  Written as a branch-free scan so the
+// compiler vectorizes it; down a column compares each row with the row below, which is
+// contiguous.  The body is compiled once per instruction set level below.
+inline __attribute__(( always_inline))
+bool canMoveBody( const unsigned char exponents[], int squaresPerSide)
+{
+    int n = squaresPerSide;
+    int found = 0;
+    for( int i = 0; i < n * n; i++) {
+        found |= (exponents[ i] == 0);
+    }
+    for( int i = 0; i < n * n - n; i++) {
+        found |= (exponents[ i] == exponents[ i + n]);
+    }
+    for( int i = 0; i < n; i++) {
+        const unsigned char *row = &exponents[ i * n];
+        for( int j = 0; j < n - 1; j++) {
+            found |= (row[ j] == row[ j + 1]);
+        }
+    }
+    return found != 0;
+}
+
+
+//---------------------------------------------------------------------------------------
+// One version of the game-over and evaluation kernels per level.  Each only differs in the
+// instructions the compiler may use for the shared body.
+bool canMoveScalar( const unsigned char exponents[], int squaresPerSide)
+{
+    return canMoveBody( exponents, squaresPerSide);
+}
+
+int evaluateHeuristicScan( const unsigned char exponents[], int squaresPerSide)
+{
+    return evaluateHeuristicScanBody( exponents, squaresPerSide);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__(( target( "sse4.2")))
+bool canMoveSse42( const unsigned char exponents[], int squaresPerSide)
+{
+    return canMoveBody( exponents, squaresPerSide);
+}
+
+__attribute__(( target( "sse4.2")))
+int evaluateHeuristicScanSse42( const unsigned char exponents[], int squaresPerSide)
+{
+    return evaluateHeuristicScanBody( exponents, squaresPerSide);
+}
+
+__attribute__(( target( "avx2")))
+bool canMoveAvx2( const unsigned char exponents[], int squaresPerSide)
+{
+    return canMoveBody( exponents, squaresPerSide);
+}
+
+__attribute__(( target( "avx2")))
+int evaluateHeuristicScanAvx2( const unsigned char exponents[], int squaresPerSide)
+{
+    return evaluateHeuristicScanBody( exponents, squaresPerSide);
+}
+
+__attribute__(( target( "avx512f,avx512bw")))
+bool canMoveAvx512( const unsigned char exponents[], int squaresPerSide)
+{
+    return canMoveBody( exponents, squaresPerSide);
+}
+
+__attribute__(( target( "avx512f,avx512bw")))
+int evaluateHeuristicScanAvx512( const unsigned char exponents[], int squaresPerSide)
+{
+    return evaluateHeuristicScanBody( exponents, squaresPerSide);
+}
+#endif
+
+
+//---------------------------------------------------------------------------------------
+// Best instruction set level this processor supports.
+SimdLevel detectSimdLevel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx512f") && __builtin_cpu_supports( "avx512bw")) {
+        return SimdAvx512;
+    }
+    if( __builtin_cpu_supports( "avx2")) {
+        return SimdAvx2;
+    }
+    if( __builtin_cpu_supports( "sse4.2") && __builtin_cpu_supports( "ssse3")) {
+        return SimdSse42;
+    }
+#endif
+    return SimdScalar;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Fill in a kernel table for the given level.  The level must be supported by the processor.
+void selectKernels( KernelTable &table, SimdLevel level)
+{
+    table.level = level;
+    table.slideRows = slideExponentRowsScalar;
+    table.slideRowsName = "scalar";
+    table.canMove = canMoveScalar;
+    table.canMoveName = "scalar";
+    table.evaluate = evaluateHeuristicScan;
+    table.evaluateName = "scalar";
+#if defined(__x86_64__) || defined(__i386__)
+    switch( level) {
+        case SimdAvx512:
+            // A row is at most 12 bytes, so the AVX2 row kernel (two rows per register) is
+            // kept; the scans are the ones that gain from wider registers.
+            table.slideRows = slideExponentRowsAvx2;
+            table.slideRowsName = "avx2";
+            table.canMove = canMoveAvx512;
+            table.canMoveName = "avx512";
+            table.evaluate = evaluateHeuristicScanAvx512;
+            table.evaluateName = "avx512";
+            break;
+        case SimdAvx2:
+            table.slideRows = slideExponentRowsAvx2;
+            table.slideRowsName = "avx2";
+            table.canMove = canMoveAvx2;
+            table.canMoveName = "avx2";
+            table.evaluate = evaluateHeuristicScanAvx2;
+            table.evaluateName = "avx2";
+            break;
+        case SimdSse42:
+            table.slideRows = slideExponentRowsSsse3;
+            table.slideRowsName = "ssse3";
+            table.canMove = canMoveSse42;
+            table.canMoveName = "sse4.2";
+            table.evaluate = evaluateHeuristicScanSse42;
+            table.evaluateName = "sse4.2";
+            break;
+        default:
+            break;
+    }
+#endif
+}
+
+
+//---------------------------------------------------------------------------------------
+// Detect the processor's features and choose the kernels.  forcedLevel is the level asked
+// for with --simd=<level>, or SimdLevelCount for the best one available; asking for more
+// than the processor supports falls back to what it does support.
+void initializeKernels( SimdLevel forcedLevel = SimdLevelCount)
+{
+    initializeSimdTables();
+    SimdLevel detected = detectSimdLevel();
+    selectKernels( activeKernels, std::min( forcedLevel, detected));
+    activeKernels.detectedLevel = detected;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Report the chosen kernels, as part of the startup banner.
+void displayKernels()
+{
+    std::cout << "Processor supports: " << simdLevelNames[ activeKernels.detectedLevel]
+              << ".  Using " << simdLevelNames[ activeKernels.level] << " kernels: moves "
+              << activeKernels.slideRowsName << ", game over check " << activeKernels.canMoveName
+              << ", evaluation " << activeKernels.evaluateName << ".\n"
+              << "  \n";
+}
+
+
+//---------------------------------------------------------------------------------------
+// Make a move on a board of tile exponents, using the chosen row kernel.  As with
+// makeFastMove(), columns are moved as the rows of the transposed board.
+bool makeExponentMove( unsigned char exponents[], char direction, int squaresPerSide, int &score)
+{
+    bool vertical = (direction == 'W' || direction == 'S');
+    bool towardsStart = (direction == 'A' || direction == 'W');
+    bool changed = false;
+    if( vertical) {
+        transposeBoard( exponents, squaresPerSide);
+    }
+    long long points = 0;   // The kernels add up points for boards of any size
+    activeKernels.slideRows( exponents, squaresPerSide, squaresPerSide, towardsStart, points, changed);
+    score += (int) points;
+    if( vertical) {
+        transposeBoard( exponents, squaresPerSide);
+    }
+    return changed;
+}
+
+
+//---------------------------------------------------------------------------------------
+// All four moves at once.
+// The AI, the game-over check and hints all need the result of every direction from the
+// same board.  Rather than four separate moves, each row is read once and slid both ways
+// for 'A' and 'D', and the board is transposed once so that each column is a contiguous
+// row that can be slid both ways for 'W' and 'S'.
+const char SuccessorDirections[ 4] = { 'W', 'A', 'S', 'D'};
+
+struct Successors {
+    int boards[ 4][ MaxBoardSize * MaxBoardSize];   // Board after each of W, A, S, D
+    bool changed[ 4];                               // Whether that move changed the board
+    int points[ 4];                                 // Points scored by that move
+};
+
+
+//---------------------------------------------------------------------------------------
+// Slide every row of rows[] towards its start into toStart[], and towards its end into
+// toEnd[], adding the points of each to the matching score.
+void slideRowsBothWays( const int rows[], int toStart[], int toEnd[], int squaresPerSide,
+                        int &startPoints, int &endPoints)
+{
+    int n = squaresPerSide;
+    int forward[ MaxBoardSize];
+    int backward[ MaxBoardSize];
+    for( int i = 0; i < n; i++) {
+        const int *row = &rows[ i * n];
+        for( int j = 0; j < n; j++) {
+            forward[ j] = row[ j];
+            backward[ j] = row[ n - 1 - j];
+        }
+        slideLine( forward, n, startPoints);
+        slideLine( backward, n, endPoints);
+        for( int j = 0; j < n; j++) {
+            toStart[ i * n + j] = forward[ j];
+            toEnd[ i * n + n - 1 - j] = backward[ j];
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Compute the board after each of the four moves, with changed flags and points.
+void computeSuccessors( int board[], int squaresPerSide, Successors &result)
+{
+    int n = squaresPerSide;
+    for( int d = 0; d < 4; d++) {
+        result.points[ d] = 0;
+    }
+
+    if( n == PackedSide && fitsPacked( board)) {
+        // The packed tables already do a whole row at a time; the board is transposed once
+        // and shared by 'W' and 'S'.
+        PackedBoard packed = packBoard( board);
+        PackedBoard columns = transposePacked( packed);
+        PackedBoard after[ 4] = { 0, 0, 0, 0};
+        for( int i = 0; i < PackedSide; i++) {
+            int row = (packed >> (16 * i)) & 0xFFFF;
+            int column = (columns >> (16 * i)) & 0xFFFF;
+            after[ 0] |= (PackedBoard) rowLeftTable[ column] << (16 * i);
+            after[ 1] |= (PackedBoard) rowLeftTable[ row] << (16 * i);
+            after[ 2] |= (PackedBoard) rowRightTable[ column] << (16 * i);
+            after[ 3] |= (PackedBoard) rowRightTable[ row] << (16 * i);
+            result.points[ 0] += rowScoreTable[ column];
+            result.points[ 1] += rowScoreTable[ row];
+        }
+        result.points[ 2] = result.points[ 0];
+        result.points[ 3] = result.points[ 1];
+        after[ 0] = transposePacked( after[ 0]);
+        after[ 2] = transposePacked( after[ 2]);
+        for( int d = 0; d < 4; d++) {
+            unpackBoard( after[ d], result.boards[ d]);
+            result.changed[ d] = (after[ d] != packed);
+        }
+        return;
+    }
+
+    // 'A' and 'D' straight from the rows of the board
+    slideRowsBothWays( board, result.boards[ 1], result.boards[ 3], n, result.points[ 1], result.points[ 3]);
+
+    // 'W' and 'S' from the rows of the transposed board, then transposed back
+    int columns[ MaxBoardSize * MaxBoardSize];
+    int up[ MaxBoardSize * MaxBoardSize];
+    int down[ MaxBoardSize * MaxBoardSize];
+    transposeInto( board, columns, n);
+    slideRowsBothWays( columns, up, down, n, result.points[ 0], result.points[ 2]);
+    transposeInto( up, result.boards[ 0], n);
+    transposeInto( down, result.boards[ 2], n);
+
+    for( int d = 0; d < 4; d++) {
+        result.changed[ d] = boardChanged( result.boards[ d], board, n, 0);
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+//this function is checking if my board is full or not, meaning that no move can change it.
+//the kernels work on exponents, so a board with other tiles put on it by 'p' compares values.
+bool boardFull(int board[], int squaresPerSide){
+    if(fitsExponents(board, squaresPerSide)){
+        unsigned char exponents[MaxBoardSize*MaxBoardSize];
+        boardToExponents(board, exponents, squaresPerSide);
+        return !activeKernels.canMove(exponents, squaresPerSide);
+    }
+    
+    //checking if the board have empty space.
+    for ( int i = 0; i < squaresPerSide*squaresPerSide; i++){
+        if(board[i] == 0){
+            return false;
+        }
+    }
+    
+    //checking if the rows or the columns can combine or not.
+    for( int i = 0; i < squaresPerSide; i++){
+        for (int j = 0; j < squaresPerSide - 1; j++){
+            if(board[getIndex(i,j,squaresPerSide)] == board[getIndex(i,j+1,squaresPerSide)] ||
+               board[getIndex(j,i,squaresPerSide)] == board[getIndex(j+1,i,squaresPerSide)]){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Suggest a move by trying each direction and keeping the one whose points plus heuristic
+// score is best.  Returns ' ' if no move changes the board.
+char suggestMove( int board[], int squaresPerSide)
+{
+    TRACE_SCOPE( "suggestMove");
+    const char directions[ 4] = { 'W', 'A', 'S', 'D'};
+    char bestDirection = ' ';
+    int bestValue = 0;
+
+    // A 4x4 board can use the packed move and evaluation tables, unless 'p' has put a tile
+    // on it that they cannot hold
+    if( squaresPerSide == PackedSide && fitsPacked( board)) {
+        PackedBoard packed = packBoard( board);
+        for( int d = 0; d < 4; d++) {
+            int points = 0;
+            PackedBoard after = executePackedMove( packed, directions[ d], points);
+            int value = points + evaluateHeuristicPacked( after);
+            if( after != packed && (bestDirection == ' ' || value > bestValue)) {
+                bestDirection = directions[ d];
+                bestValue = value;
+            }
+        }
+        return bestDirection;
+    }
+
+    Successors successors;
+    computeSuccessors( board, squaresPerSide, successors);
+    for( int d = 0; d < 4; d++) {
+        if( !successors.changed[ d]) {
+            continue;
+        }
+        int value = successors.points[ d] + evaluateHeuristic( successors.boards[ d], squaresPerSide);
+        if( bestDirection == ' ' || value > bestValue) {
+            bestDirection = directions[ d];
+            bestValue = value;
+        }
+    }
+    return bestDirection;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Check the kernels of every level this processor supports against the game's own code
+// (movePieces() and combine(), the four successor boards, and heuristicLine()) on random
+// boards of every size, and time them on 12x12 boards.
+// Run it using:   ./sfml-app --check-kernels
+void checkKernels()
+{
+    const int BoardsPerSize = 20000;
+    FastRandom random( (uint64_t) time( NULL));
+    KernelTable saved = activeKernels;
+
+    for( int level = SimdScalar; level <= saved.detectedLevel; level++) {
+        selectKernels( activeKernels, (SimdLevel) level);
+        long long moveMismatches = 0;
+        long long canMoveMismatches = 0;
+        long long evaluateMismatches = 0;
+        long long moves = 0;
+        for( int n = 4; n <= MaxBoardSize; n++) {
+            for( int b = 0; b < BoardsPerSize; b++) {
+                // Half the boards have no empty squares, so that some of them are game over
+                int board[ MaxBoardSize * MaxBoardSize];
+                for( int i = 0; i < n * n; i++) {
+                    int exponent = (b % 2 == 0) ? random.nextInt( 5) : 1 + random.nextInt( 2 * n);
+                    board[ i] = (exponent == 0) ? 0 : (1 << exponent);
+                }
+                unsigned char exponents[ MaxBoardSize * MaxBoardSize];
+                boardToExponents( board, exponents, n);
+
+                Successors expected;
+                computeSuccessors( board, n, expected);
+                bool expectedCanMove = false;
+                for( int d = 0; d < 4; d++) {
+                    expectedCanMove |= expected.changed[ d];
+                }
+                canMoveMismatches += (activeKernels.canMove( exponents, n) != expectedCanMove);
+
+                unsigned char line[ MaxBoardSize];
+                int expectedValue = 0;
+                for( int k = 0; k < n; k++) {
+                    for( int i = 0; i < n; i++) {
+                        line[ i] = exponents[ getIndex( k, i, n)];
+                    }
+                    expectedValue += heuristicLine( line, n);
+                    for( int i = 0; i < n; i++) {
+                        line[ i] = exponents[ getIndex( i, k, n)];
+                    }
+                    expectedValue += heuristicLine( line, n);
+                }
+                evaluateMismatches += (activeKernels.evaluate( exponents, n) != expectedValue);
+
+                for( int d = 0; d < 4; d++) {
+                    char direction = SuccessorDirections[ d];
+                    int reference[ MaxBoardSize * MaxBoardSize];
+                    int referenceScore = 0;
+                    int theMove = 0;
+                    int theSize = n;
+                    Timeline noHistory;
+                    copyBoard( board, reference, n, 0);
+                    movePieces( reference, direction, theSize, referenceScore, theMove, noHistory);
+                    combine( reference, direction, theSize, referenceScore, theMove, noHistory);
+
+                    unsigned char moved[ MaxBoardSize * MaxBoardSize];
+                    unsigned char referenceExponents[ MaxBoardSize * MaxBoardSize];
+                    memcpy( moved, exponents, n * n);
+                    boardToExponents( reference, referenceExponents, n);
+                    int score = 0;
+                    bool changed = makeExponentMove( moved, direction, n, score);
+                    moves++;
+                    if( memcmp( moved, referenceExponents, n * n) != 0 || score != referenceScore
+                        || changed != boardChanged( reference, board, n, 0)) {
+                        moveMismatches++;
+                    }
+                }
+            }
+        }
+
+        // Boards with tiles put on them by 'p', which have no exponent: a 3 is not an empty
+        // square, and a 6 does not combine with a 2.  No move changes either of them.
+        int placedBoards[ 2][ PackedSide * PackedSide] = {
+            { 2, 4, 2, 4,  4, 2, 4, 2,  2, 4, 2, 4,  4, 2, 4, 3},
+            { 2, 4, 2, 4,  4, 2, 4, 2,  2, 4, 2, 4,  4, 2, 6, 2}
+        };
+        for( int b = 0; b < 2; b++) {
+            Successors expected;
+            computeSuccessors( placedBoards[ b], PackedSide, expected);
+            bool expectedCanMove = false;
+            for( int d = 0; d < 4; d++) {
+                expectedCanMove |= expected.changed[ d];
+            }
+            canMoveMismatches += (boardFull( placedBoards[ b], PackedSide) == expectedCanMove);
+        }
+
+        // Time each kernel on 12x12 boards, away from the slow reference code
+        const int SquareCount = MaxBoardSize * MaxBoardSize;
+        std::vector<unsigned char> timingBoards( BoardsPerSize * SquareCount);
+        for( size_t i = 0; i < timingBoards.size(); i++) {
+            timingBoards[ i] = 1 + random.nextInt( 16);
+        }
+        volatile long long sink = 0;   // Keeps the compiler from skipping the timed calls
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for( int b = 0; b < BoardsPerSize; b++) {
+            sink = sink + activeKernels.canMove( &timingBoards[ b * SquareCount], MaxBoardSize);
+        }
+        std::chrono::steady_clock::time_point afterCanMove = std::chrono::steady_clock::now();
+        for( int b = 0; b < BoardsPerSize; b++) {
+            sink = sink + activeKernels.evaluate( &timingBoards[ b * SquareCount], MaxBoardSize);
+        }
+        std::chrono::steady_clock::time_point afterEvaluate = std::chrono::steady_clock::now();
+        for( int b = 0; b < BoardsPerSize; b++) {
+            int score = 0;   // One board's points fit in an int; all of them together do not
+            makeExponentMove( &timingBoards[ b * SquareCount], SuccessorDirections[ b % 4], MaxBoardSize, score);
+            sink = sink + score;
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        double nanoseconds = 1e9 / BoardsPerSize;
+
+        std::cout << simdLevelNames[ level] << ":" << std::endl;
+        std::cout << "   moves (" << activeKernels.slideRowsName << "): " << moves << " checked, "
+                  << moveMismatches << " wrong, "
+                  << std::chrono::duration<double>( end - afterEvaluate).count() * nanoseconds << " ns" << std::endl;
+        std::cout << "   game over check (" << activeKernels.canMoveName << "): " << canMoveMismatches << " wrong, "
+                  << std::chrono::duration<double>( afterCanMove - start).count() * nanoseconds << " ns" << std::endl;
+        std::cout << "   evaluation (" << activeKernels.evaluateName << "): " << evaluateMismatches << " wrong, "
+                  << std::chrono::duration<double>( afterEvaluate - afterCanMove).count() * nanoseconds << " ns" << std::endl;
+    }
+    activeKernels = saved;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Simple pool of worker threads that stay alive between batches of work.
+// runTasks( count, task) calls task( worker, taskNumber) for every taskNumber from 0 to
+// count-1, spread across the workers, and returns once all of them have finished.  The
+// worker number lets each task use per-thread state such as its own random numbers.
+class ThreadPool {
+	public:
+		ThreadPool( int threadCount)
+		{
+			if( threadCount < 1) {
+				threadCount = 1;
+			}
+			pTask = NULL;
+			taskCount = 0;
+			nextTask = 0;
+			busyWorkers = 0;
+			batchNumber = 0;
+			stopping = false;
+			for( int i = 0; i < threadCount; i++) {
+				workers.push_back( std::thread( &ThreadPool::workerLoop, this, i));
+			}
+		}
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock( mutex);
+				stopping = true;
+			}
+			wakeWorkers.notify_all();
+			for( size_t i = 0; i < workers.size(); i++) {
+				workers[ i].join();
+			}
+		}
+
+		int getThreadCount() { return (int) workers.size(); }
+
+		void runTasks( int count, const std::function<void(int, int)> &task)
+		{
+			std::unique_lock<std::mutex> lock( mutex);
+			pTask = &task;
+			taskCount = count;
+			nextTask = 0;
+			busyWorkers = (int) workers.size();
+			batchNumber++;
+			wakeWorkers.notify_all();
+			batchDone.wait( lock, [this] { return busyWorkers == 0; });
+			pTask = NULL;
+		}
+
+	private:
+		void workerLoop( int worker)
+		{
+			long long lastBatch = 0;
+			while( true) {
+				const std::function<void(int, int)> *pTheTask;
+				int theCount;
+				{
+					std::unique_lock<std::mutex> lock( mutex);
+					wakeWorkers.wait( lock, [&] { return stopping || batchNumber != lastBatch; });
+					if( stopping) {
+						return;
+					}
+					lastBatch = batchNumber;
+					pTheTask = pTask;
+					theCount = taskCount;
+				}
+				// Take tasks one at a time until there are none left
+				for( int t = nextTask.fetch_add( 1); t < theCount; t = nextTask.fetch_add( 1)) {
+					(*pTheTask)( worker, t);
+				}
+				std::lock_guard<std::mutex> lock( mutex);
+				if( --busyWorkers == 0) {
+					batchDone.notify_one();
+				}
+			}
+		}
+
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wakeWorkers;
+		std::condition_variable batchDone;
+		const std::function<void(int, int)> *pTask;
+		int taskCount;
+		std::atomic<int> nextTask;
+		int busyWorkers;
+		long long batchNumber;
+		bool stopping;
+
+}; //end class ThreadPool
+
+
+//---------------------------------------------------------------------------------------
+// Large boards, for stress testing sizes far beyond MaxBoardSize (64x64 up to 4096x4096).
+// The cells are tile exponents, one byte each, in storage allocated for exactly the chosen
+// size and aligned to a cache line, so a 4096x4096 board takes 16 MB and a 64x64 board 4 KB.
+class LargeBoard {
+	public:
+		LargeBoard( int theSquaresPerSide)
+		{
+			squaresPerSide = theSquaresPerSide;
+			size_t bytes = (size_t) squaresPerSide * squaresPerSide;
+			storage = new unsigned char[ bytes + CacheLineSize];
+			cells = storage + (CacheLineSize - ((uintptr_t) storage % CacheLineSize)) % CacheLineSize;
+			memset( cells, 0, bytes);
+		}
+
+		~LargeBoard() { delete [] storage; }
+
+		// Get (accessor) functions
+		int getSquaresPerSide() { return squaresPerSide; }
+		unsigned char *getCells() { return cells; }
+		unsigned char *getRow( int row) { return cells + (size_t) row * squaresPerSide; }
+		size_t getMemoryUsed() { return (size_t) squaresPerSide * squaresPerSide + CacheLineSize; }
+
+		static const int CacheLineSize = 64;
+
+	private:
+		LargeBoard( const LargeBoard &);              // Boards are too big to copy by accident
+		LargeBoard &operator=( const LargeBoard &);
+
+		int squaresPerSide;
+		unsigned char *storage;   // As allocated
+		unsigned char *cells;     // First cache line boundary within storage
+
+}; //end class LargeBoard
+
+
+//---------------------------------------------------------------------------------------
+// Rows are independent of each other in a left or right move, and columns in an up or down
+// move, so a move on a large board is split into blocks: LargeRowBlock rows for left and
+// right, and strips LargeStripWidth columns wide for up and down.  Each block is moved on its
+// own, recording its points, whether it changed, and how many open squares it has left.
+// Those counts are merged afterwards to place the random piece without scanning the board.
+// Below ParallelMoveThreshold squares per side a whole move takes well under a millisecond,
+// which is no more than waking the pool costs, so smaller boards are moved on this thread.
+const int LargeRowBlock = 64;
+const int LargeStripWidth = LargeBoard::CacheLineSize;
+const int ParallelMoveThreshold = 512;
+
+struct LargeMoveBlocks {
+    bool columnStrips;                                 // Blocks are column strips, not rows
+    int blockSize;                                     // Rows or columns per block
+    std::vector<size_t> emptyCounts;                   // Open squares per block after the move
+    std::vector<long long> points;
+    std::vector<char> changed;
+    std::vector< std::vector<unsigned char> > buffers; // One strip buffer per worker
+};
+
+
+//---------------------------------------------------------------------------------------
+// Move rows firstRow up to (not including) lastRow of a large board left or right,
+// returning how many open squares those rows have afterwards.
+size_t moveLargeRows( LargeBoard &board, int firstRow, int lastRow, bool towardsStart,
+                      long long &score, bool &changed)
+{
+    activeKernels.slideRows( board.getRow( firstRow), lastRow - firstRow, board.getSquaresPerSide(),
+                             towardsStart, score, changed);
+
+    const unsigned char *cells = board.getRow( firstRow);
+    size_t squareCount = (size_t)( lastRow - firstRow) * board.getSquaresPerSide();
+    size_t emptyCount = 0;
+    for( size_t i = 0; i < squareCount; i++) {
+        emptyCount += (cells[ i] == 0);
+    }
+    return emptyCount;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Move the strip of columns firstColumn up to (not including) lastColumn of a large board
+// up or down, returning how many open squares the strip has afterwards.  Transposing the
+// whole board would stream all of it through the cache twice, so instead each row
+// contributes one cache line to the strip, which is copied into buffer as rows, moved, and
+// copied back.  buffer must hold LargeStripWidth * squaresPerSide bytes.
+size_t moveLargeColumns( LargeBoard &board, int firstColumn, int lastColumn, bool towardsStart,
+                         long long &score, bool &changed, unsigned char buffer[])
+{
+    int n = board.getSquaresPerSide();
+    int width = lastColumn - firstColumn;
+    for( int i = 0; i < n; i++) {
+        const unsigned char *row = board.getRow( i) + firstColumn;
+        for( int j = 0; j < width; j++) {
+            buffer[ (size_t) j * n + i] = row[ j];
+        }
+    }
+    bool stripChanged = false;
+    activeKernels.slideRows( buffer, width, n, towardsStart, score, stripChanged);
+
+    size_t emptyCount = 0;
+    for( size_t i = 0; i < (size_t) width * n; i++) {
+        emptyCount += (buffer[ i] == 0);
+    }
+    if( stripChanged) {
+        changed = true;
+        for( int i = 0; i < n; i++) {
+            unsigned char *row = board.getRow( i) + firstColumn;
+            for( int j = 0; j < width; j++) {
+                row[ j] = buffer[ (size_t) j * n + i];
+            }
+        }
+    }
+    return emptyCount;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Make a move on a large board, returning true if it changed.  The blocks are shared out
+// over the pool when there is one and the board is big enough; pPool may be NULL.  Either
+// way blocks is left describing the open squares, ready for placeRandomLarge(), even when
+// the board did not change.
+bool moveLargeBoard( LargeBoard &board, char direction, long long &score,
+                     LargeMoveBlocks &blocks, ThreadPool *pPool)
+{
+    int n = board.getSquaresPerSide();
+    bool towardsStart = (direction == 'W' || direction == 'A');
+    blocks.columnStrips = (direction == 'W' || direction == 'S');
+    blocks.blockSize = blocks.columnStrips ? LargeStripWidth : LargeRowBlock;
+    int blockCount = (n + blocks.blockSize - 1) / blocks.blockSize;
+    blocks.emptyCounts.assign( blockCount, 0);
+    blocks.points.assign( blockCount, 0);
+    blocks.changed.assign( blockCount, 0);
+
+    bool parallel = pPool != NULL && pPool->getThreadCount() > 1 && n >= ParallelMoveThreshold;
+    int workerCount = parallel ? pPool->getThreadCount() : 1;
+    if( blocks.columnStrips && (int) blocks.buffers.size() < workerCount) {
+        blocks.buffers.resize( workerCount);
+    }
+
+    auto moveBlock = [&]( int worker, int block) {
+        TRACE_SCOPE( "large board block");
+        int first = block * blocks.blockSize;
+        int last = std::min( n, first + blocks.blockSize);
+        bool changed = false;
+        if( blocks.columnStrips) {
+            std::vector<unsigned char> &buffer = blocks.buffers[ worker];
+            buffer.resize( (size_t) LargeStripWidth * n);
+            blocks.emptyCounts[ block] = moveLargeColumns( board, first, last, towardsStart,
+                                                           blocks.points[ block], changed, &buffer[ 0]);
+        }
+        else {
+            blocks.emptyCounts[ block] = moveLargeRows( board, first, last, towardsStart,
+                                                        blocks.points[ block], changed);
+        }
+        blocks.changed[ block] = changed;
+    };
+    if( parallel) {
+        pPool->runTasks( blockCount, moveBlock);
+    }
+    else {
+        for( int block = 0; block < blockCount; block++) {
+            moveBlock( 0, block);
+        }
+    }
+
+    bool changed = false;
+    for( int block = 0; block < blockCount; block++) {
+        score += blocks.points[ block];
+        changed = changed || blocks.changed[ block];
+    }
+    return changed;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Same rules as placeRandomPiece() for a large board: a 2 or a 4 with equal chance, in a
+// random open square.  The open squares are found from the counts left by the last
+// moveLargeBoard(), so only the block the piece lands in is scanned.  Returns false if
+// there were no open squares.
+bool placeRandomLarge( LargeBoard &board, LargeMoveBlocks &blocks, FastRandom &random)
+{
+    size_t emptyCount = 0;
+    for( size_t block = 0; block < blocks.emptyCounts.size(); block++) {
+        emptyCount += blocks.emptyCounts[ block];
+    }
+    if( emptyCount == 0) {
+        return false;
+    }
+    unsigned char exponent = (random.nextInt( 2) == 1) ? 2 : 1;
+    size_t target = (size_t)( random.next() % emptyCount);
+    int block = 0;
+    while( target >= blocks.emptyCounts[ block]) {
+        target -= blocks.emptyCounts[ block];
+        block++;
+    }
+    blocks.emptyCounts[ block]--;
+
+    int n = board.getSquaresPerSide();
+    int first = block * blocks.blockSize;
+    int last = std::min( n, first + blocks.blockSize);
+    if( blocks.columnStrips) {
+        for( int i = 0; ; i++) {
+            unsigned char *row = board.getRow( i);
+            for( int j = first; j < last; j++) {
+                if( row[ j] == 0 && target-- == 0) {
+                    row[ j] = exponent;
+                    return true;
+                }
+            }
+        }
+    }
+    unsigned char *cells = board.getRow( first);
+    for( size_t i = 0; ; i++) {
+        if( cells[ i] == 0 && target-- == 0) {
+            cells[ i] = exponent;
+            return true;
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Stress test: play random moves on a board of any size and report the time per move.
+// Run it using:   ./sfml-app --stress <size> [moves] [threads]
+void runStressTest( int squaresPerSide, long long moveCount, int threadCount)
+{
+    if( squaresPerSide < 2) {
+        std::cout << "Board size must be at least 2" << std::endl;
+        return;
+    }
+    const char directions[ 4] = { 'W', 'A', 'S', 'D'};
+    LargeBoard board( squaresPerSide);
+    LargeMoveBlocks blocks;
+    ThreadPool pool( threadCount);
+    FastRandom random( (uint64_t) time( NULL));
+    std::cout << "Stress test on " << squaresPerSide << "x" << squaresPerSide << " board using "
+              << board.getMemoryUsed() / 1024.0 << " KB, moves "
+              << ((pool.getThreadCount() > 1 && squaresPerSide >= ParallelMoveThreshold)
+                  ? "split over " + std::to_string( pool.getThreadCount()) + " threads" : "on one thread")
+              << std::endl;
+
+    // Start with about a quarter of the squares filled, so there is work to do from the first move
+    size_t squareCount = (size_t) squaresPerSide * squaresPerSide;
+    for( size_t i = 0; i < squareCount; i++) {
+        if( random.nextInt( 4) == 0) {
+            board.getCells()[ i] = (random.nextInt( 2) == 1) ? 2 : 1;
+        }
+    }
+
+    long long score = 0;
+    long long moves = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double moveSeconds = 0;
+    while( moves < moveCount) {
+        int first = random.nextInt( 4);
+        bool moved = false;
+        std::chrono::steady_clock::time_point moveStart = std::chrono::steady_clock::now();
+        for( int d = 0; d < 4 && !moved; d++) {
+            moved = moveLargeBoard( board, directions[ (first + d) % 4], score, blocks, &pool);
+        }
+        moveSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - moveStart).count();
+        if( !moved) {
+            std::cout << "No more available moves." << std::endl;
+            break;
+        }
+        placeRandomLarge( board, blocks, random);
+        moves++;
+    }
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start).count();
+    std::cout << moves << " moves, score " << score << ": " << moveSeconds / std::max( 1LL, moves) * 1000
+              << " ms per move, " << seconds / std::max( 1LL, moves) * 1000
+              << " ms per move including the random piece" << std::endl;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Make one random move: try the directions in a random order until one of them changes the
+// board, then place a random piece.  Returns false, leaving the board alone, if no move is
+// possible.  The points of the move are added to points.
+template <typename Rules = ClassicRules>
+bool playRandomMove( int board[], int squaresPerSide, long long &points, FastRandom &random)
+{
+    const char directions[ 4] = { 'W', 'A', 'S', 'D'};
+    int first = random.nextInt( 4);
+    for( int d = 0; d < 4; d++) {
+        int score = 0;
+        if( makeFastMove<Rules>( board, directions[ (first + d) % 4], squaresPerSide, score)) {
+            points += score;
+            placeRandomFast<Rules>( board, squaresPerSide, random);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Play random moves from the given board until no move is possible or maxMoves moves have
+// been made, returning the points scored along the way.  The board is changed in place.
+// The move limit matters on big boards: random play on an 8x8 board can go on for hundreds
+// of thousands of moves before it gets stuck.
+long long randomPlayout( int board[], int squaresPerSide, int maxMoves, FastRandom &random)
+{
+    long long points = 0;
+    for( int move = 0; move < maxMoves && playRandomMove( board, squaresPerSide, points, random); move++) {
+    }
+    return points;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Monte Carlo move advisor.
+// For each direction that changes the board, play random games starting from the resulting
+// board (up to MaxPlayoutMoves moves each), and choose the direction with the best average
+// points.  Playouts run in batches across the thread pool, each worker using its own random
+// numbers, until every direction has playoutsPerMove playouts or the time budget (in
+// milliseconds) runs out.  If pCancel is given, setting it also stops the search after the
+// current batch.  Returns ' ' if no move changes the board.
+char monteCarloMove( int board[], int squaresPerSide, int playoutsPerMove, int timeBudget,
+                     ThreadPool &pool, std::vector<FastRandom> &randoms,
+                     const std::atomic<bool> *pCancel = NULL)
+{
+    TRACE_SCOPE( "monteCarloMove");
+    const char directions[ 4] = { 'W', 'A', 'S', 'D'};
+    const int PlayoutsPerTask = 4;
+    const int MaxPlayoutMoves = 200;
+    int n = squaresPerSide;
+
+    // The board after each legal first move
+    Successors first;
+    computeSuccessors( board, n, first);
+    int legal[ 4];
+    int legalCount = 0;
+    for( int d = 0; d < 4; d++) {
+        if( first.changed[ d]) {
+            legal[ legalCount++] = d;
+        }
+    }
+    if( legalCount == 0) {
+        return ' ';
+    }
+    if( legalCount == 1) {
+        return directions[ legal[ 0]];
+    }
+
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds( timeBudget);
+    double totals[ 4] = { 0, 0, 0, 0};
+    int playouts = 0;
+    // Each batch gives every direction one task per worker
+    int tasksPerDirection = pool.getThreadCount();
+    std::vector<long long> taskPoints( legalCount * tasksPerDirection);
+    do {
+        pool.runTasks( legalCount * tasksPerDirection, [&]( int worker, int task) {
+            TRACE_SCOPE( "playouts");
+            int d = legal[ task / tasksPerDirection];
+            long long sum = 0;
+            int playoutBoard[ MaxBoardSize * MaxBoardSize];
+            for( int p = 0; p < PlayoutsPerTask; p++) {
+                copyBoard( first.boards[ d], playoutBoard, n, 0);
+                placeRandomFast( playoutBoard, n, randoms[ worker]);
+                sum += first.points[ d] + randomPlayout( playoutBoard, n, MaxPlayoutMoves, randoms[ worker]);
+            }
+            taskPoints[ task] = sum;
+        });
+        for( int task = 0; task < legalCount * tasksPerDirection; task++) {
+            totals[ legal[ task / tasksPerDirection]] += taskPoints[ task];
+        }
+        playouts += tasksPerDirection * PlayoutsPerTask;
+    } while( playouts < playoutsPerMove && std::chrono::steady_clock::now() < deadline &&
+             (pCancel == NULL || !pCancel->load()));
+
+    int best = legal[ 0];
+    for( int k = 1; k < legalCount; k++) {
+        if( totals[ legal[ k]] > totals[ best]) {
+            best = legal[ k];
+        }
+    }
+    return directions[ best];
+}
+
+
+//---------------------------------------------------------------------------------------
+// How hard the game's Monte Carlo hint searches: playouts per direction, and milliseconds
+const int AdvisorPlayouts = 400;
+const int AdvisorMilliseconds = 500;
+
+// Create the thread pool and per-thread random numbers used by the Monte Carlo advisor.
+void createAdvisorPool( ThreadPool* &pPool, std::vector<FastRandom> &randoms)
+{
+    if( pPool == NULL) {
+        pPool = new ThreadPool( std::thread::hardware_concurrency());
+        for( int i = 0; i < pPool->getThreadCount(); i++) {
+            randoms.push_back( FastRandom( (uint64_t) time( NULL) * 2654435761ULL + i));
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Headless bot: play a whole game on the given board size using the Monte Carlo advisor.
+// Run it using:   ./sfml-app --bot <size> [playoutsPerMove] [timeBudgetMilliseconds]
+void runMonteCarloBot( int squaresPerSide, int playoutsPerMove, int timeBudget)
+{
+    if( squaresPerSide < 4 || squaresPerSide > MaxBoardSize) {
+        std::cout << "Board size must be between 4 and " << MaxBoardSize << std::endl;
+        return;
+    }
+    ThreadPool *pPool = NULL;
+    std::vector<FastRandom> randoms;
+    createAdvisorPool( pPool, randoms);
+    FastRandom random( (uint64_t) time( NULL));
+
+    int board[ MaxBoardSize * MaxBoardSize];
+    int n = squaresPerSide;
+    int score = 0;
+    int move = 1;
+    for( int i = 0; i < n * n; i++) {
+        board[ i] = 0;
+    }
+    placeRandomFast( board, n, random);
+    placeRandomFast( board, n, random);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while( !maxGoal( board, n)) {
+        char direction = monteCarloMove( board, n, playoutsPerMove, timeBudget, *pPool, randoms);
+        if( direction == ' ') {
+            break;
+        }
+        makeFastMove( board, direction, n, score);
+        placeRandomFast( board, n, random);
+        move++;
+        if( move % 100 == 0) {
+            std::cout << "Move " << move << ", score " << score << std::endl;
+        }
+    }
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start).count();
+    std::cout << (maxGoal( board, n) ? "Reached " : "No more available moves before reaching ")
+              << boardGoal( n) << " after " << move << " moves, score " << score
+              << ", " << seconds / move * 1000 << " ms per move" << std::endl;
+    delete pPool;
+}
+
+//---------------------------------------------------------------------------------------
+// Scripted games, for regression tests and replaying recorded sessions.  The script is the
+// same letters a player would type (moves W A S D, U to undo, Y to redo, J <move> to jump,
+// P <square> <value> to place a piece, R <size> to reset, X to stop), read from a file or
+// from stdin in large chunks rather than a character at a time.
+const size_t ScriptChunkSize = 64 * 1024;
+
+class ScriptReader {
+	public:
+		ScriptReader( FILE *pTheFile)
+		{
+			pFile = pTheFile;
+			buffer.resize( ScriptChunkSize);
+			position = 0;
+			length = 0;
+		}
+
+		// Get the next command letter, in upper case.  Returns false at the end of the script.
+		bool nextCommand( char &command)
+		{
+			int c = nextNonSpace();
+			if( c == EOF) {
+				return false;
+			}
+			command = toupper( c);
+			return true;
+		}
+
+		// Get the number following a command, returning false if there is none
+		bool nextNumber( int &value)
+		{
+			int c = nextNonSpace();
+			bool negative = (c == '-');
+			if( negative) {
+				c = nextChar();
+			}
+			if( c == EOF || !isdigit( c)) {
+				if( c != EOF) {
+					position--;            // Leave it to be read as the next command
+				}
+				return false;
+			}
+			value = 0;
+			while( c != EOF && isdigit( c)) {
+				value = value * 10 + (c - '0');
+				c = nextChar();
+			}
+			if( c != EOF) {
+				position--;
+			}
+			if( negative) {
+				value = -value;
+			}
+			return true;
+		}
+
+	private:
+		int nextChar()
+		{
+			if( position == length) {
+				length = fread( &buffer[ 0], 1, buffer.size(), pFile);
+				position = 0;
+				if( length == 0) {
+					return EOF;
+				}
+			}
+			return (unsigned char) buffer[ position++];
+		}
+
+		int nextNonSpace()
+		{
+			int c = nextChar();
+			while( c != EOF && isspace( c)) {
+				c = nextChar();
+			}
+			return c;
+		}
+
+		FILE *pFile;
+		std::vector<char> buffer;   // The current chunk of the script
+		size_t position;            // Next character to read from buffer
+		size_t length;              // Characters in buffer
+
+}; //end class ScriptReader
+
+
+//---------------------------------------------------------------------------------------
+// Play a script with the same rules as the interactive game, without the window or the
+// pause between moves.  The board is displayed every renderEvery moves (0 for never) and
+// once at the end.  The pieces placed come from rand(), so a script gives the same game
+// every time it is run with the same seed.  If onPosition is given, it is shown the board
+// at the start and after every command.
+// Run it using:   ./sfml-app --script <file, or - for stdin> [renderEvery] [seed]
+void runScript( const char *fileName, int renderEvery, unsigned int seed,
+                std::function<void( int board[], int squaresPerSide, int move)> onPosition = nullptr)
+{
+    FILE *pFile = (strcmp( fileName, "-") == 0) ? stdin : fopen( fileName, "r");
+    if( pFile == NULL) {
+        std::cout << "Could not open script " << fileName << std::endl;
+        return;
+    }
+    srand( seed);
+    ScriptReader script( pFile);
+    TextRenderer renderer;
+    Timeline timeline;
+    std::string message;
+
+    int squaresPerSide = 4;
+    int board[ MaxBoardSize * MaxBoardSize];
+    int move = 1;
+    int score = 0;
+    bool byPass = false;
+    resetBoard( board, squaresPerSide);
+    placeRandomPiece( board, squaresPerSide);
+    placeRandomPiece( board, squaresPerSide);
+    timeline.record( squaresPerSide, board, move, score);
+    if( onPosition) {
+        onPosition( board, squaresPerSide, move);
+    }
+
+    long long commands = 0;
+    long long moves = 0;
+    char command;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while( !boardFull( board, squaresPerSide) && (!maxGoal( board, squaresPerSide) || byPass) &&
+           script.nextCommand( command)) {
+        commands++;
+        byPass = false;
+        bool changed = false;
+        int number;
+        if( command == 'X') {
+            break;
+        }
+        else if( command == 'W' || command == 'A' || command == 'S' || command == 'D') {
+            changed = makeFastMove( board, command, squaresPerSide, score);
+        }
+        else if( command == 'U') {
+            if( !timeline.undo( squaresPerSide, board, move, score)) {
+                message = "*** You cannot undo past the beginning of the game. ***";
+            }
+        }
+        else if( command == 'Y') {
+            if( !timeline.redo( squaresPerSide, board, move, score)) {
+                message = "*** There is no move to redo. ***";
+            }
+        }
+        else if( command == 'J' && script.nextNumber( number)) {
+            if( !timeline.jumpToMove( number, squaresPerSide, board, move, score)) {
+                message = "*** Move " + std::to_string( number) + " was not played in this game. ***";
+            }
+        }
+        else if( command == 'P') {
+            int value;
+            if( script.nextNumber( number) && script.nextNumber( value) &&
+                number >= 0 && number < squaresPerSide * squaresPerSide) {
+                board[ number] = value;
+            }
+            byPass = true;
+        }
+        else if( command == 'R' && script.nextNumber( number) && number >= 4 && number <= MaxBoardSize) {
+            // Like the game: a new board with one piece, and a second one placed as a move
+            squaresPerSide = number;
+            resetBoard( board, squaresPerSide);
+            score = 0;
+            move = 0;
+            placeRandomPiece( board, squaresPerSide);
+            changed = true;
+        }
+        else {
+            message = std::string( "Ignored unknown command ") + command;
+        }
+
+        if( changed) {
+            placeRandomPiece( board, squaresPerSide);
+            move++;
+            moves++;
+            timeline.record( squaresPerSide, board, move, score);
+            if( renderEvery > 0 && moves % renderEvery == 0) {
+                displayBoardSize( squaresPerSide, board, score, timeline, renderer, message);
+                message.clear();
+            }
+        }
+        if( onPosition) {
+            onPosition( board, squaresPerSide, move);
+        }
+    }
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start).count();
+    if( pFile != stdin) {
+        fclose( pFile);
+    }
+
+    if( boardFull( board, squaresPerSide)) {
+        message += (message.empty() ? "" : "\n") + std::string( "No more available moves. Game is over.");
+    }
+    else if( maxGoal( board, squaresPerSide) && !byPass) {
+        message += (message.empty() ? "" : "\n") + ("Made it to " + std::to_string( boardGoal( squaresPerSide)) + ".");
+    }
+    displayBoardSize( squaresPerSide, board, score, timeline, renderer, message);
+    std::cout << commands << " commands, " << moves << " moves in " << seconds * 1000 << " ms ("
+              << moves / std::max( seconds, 1e-9) << " moves per second)" << std::endl;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Offscreen rendering, for exporting frames and benchmarking drawing without a display.
+// sf::RenderWindow needs an X display and OpenGL, so this draws the same frame as the
+// window (blue squares, their numbers, and the move label) into an RGB buffer in memory,
+// entirely on the CPU.  The text comes from arial.ttf through a small TrueType reader:
+// glyph outlines are flattened into line segments and filled with the non-zero rule, 4
+// scanlines per pixel row and exact coverage across each row, and each glyph is drawn once
+// per size and then kept, as sf::Font does.
+
+// Reading big-endian numbers from the font file
+inline int readFontUint16( const unsigned char *pBytes) { return (pBytes[ 0] << 8) | pBytes[ 1]; }
+inline int readFontInt16( const unsigned char *pBytes) { return (int16_t) readFontUint16( pBytes); }
+inline uint32_t readFontUint32( const unsigned char *pBytes)
+{
+    return ((uint32_t) pBytes[ 0] << 24) | (pBytes[ 1] << 16) | (pBytes[ 2] << 8) | pBytes[ 3];
+}
+
+// A glyph drawn at one size: coverage from 0 to 255 for each pixel of its bounding box,
+// which starts at (left, top) from the pen position on the baseline
+struct RasterGlyph {
+    int left;
+    int top;
+    int width;
+    int height;
+    float advance;                      // Pixels to move the pen on by
+    std::vector<unsigned char> coverage;
+};
+
+// One straight edge of an outline, in pixels with y going down
+struct OutlineEdge {
+    float x0, y0, x1, y1;
+};
+
+class SoftwareFont {
+	public:
+		SoftwareFont()
+		{
+			unitsPerEm = 0;
+		}
+
+		// Read a TrueType font file.  Returns false if it is missing or not one this reads.
+		bool loadFromFile( const char *fileName)
+		{
+			FILE *pFile = fopen( fileName, "rb");
+			if( pFile == NULL) {
+				return false;
+			}
+			std::vector<unsigned char> contents;
+			unsigned char chunk[ 65536];
+			size_t length;
+			while( (length = fread( chunk, 1, sizeof( chunk), pFile)) > 0) {
+				contents.insert( contents.end(), chunk, chunk + length);
+			}
+			fclose( pFile);
+			return loadFromMemory( contents.empty() ? NULL : &contents[ 0], contents.size());
+		}
+
+		// Read a TrueType font already in memory, which is copied
+		bool loadFromMemory( const unsigned char *pBytes, size_t length)
+		{
+			data.assign( pBytes, pBytes + length);
+			if( data.size() < 12) {
+				return false;
+			}
+			const unsigned char *pHead = findTable( "head", 54);
+			const unsigned char *pMaxp = findTable( "maxp", 6);
+			const unsigned char *pHhea = findTable( "hhea", 36);
+			pCmap = findTable( "cmap", 4);
+			pLoca = findTable( "loca", 0);
+			pGlyf = findTable( "glyf", 0);
+			pHmtx = findTable( "hmtx", 0);
+			if( pHead == NULL || pMaxp == NULL || pHhea == NULL || pCmap == NULL || pLoca == NULL ||
+			    pGlyf == NULL || pHmtx == NULL) {
+				return false;
+			}
+			unitsPerEm = readFontUint16( pHead + 18);
+			longLoca = readFontInt16( pHead + 50) != 0;
+			glyphCount = readFontUint16( pMaxp + 4);
+			horizontalMetricCount = readFontUint16( pHhea + 34);
+			pCharacterMap = findCharacterMap();
+			return unitsPerEm > 0 && pCharacterMap != NULL;
+		}
+
+		// The glyph for a character at a size in pixels, drawn the first time it is asked for
+		const RasterGlyph &getGlyph( unsigned int character, int characterSize)
+		{
+			uint64_t key = ((uint64_t) characterSize << 32) | character;
+			std::map<uint64_t, RasterGlyph>::iterator found = glyphs.find( key);
+			if( found != glyphs.end()) {
+				return found->second;
+			}
+			RasterGlyph &glyph = glyphs[ key];
+			rasterize( glyphIndex( character), (float) characterSize / unitsPerEm, glyph);
+			return glyph;
+		}
+
+	private:
+		// Find a table in the font's table directory, checking it is at least minimumLength long
+		const unsigned char *findTable( const char *tag, uint32_t minimumLength)
+		{
+			int tableCount = readFontUint16( &data[ 4]);
+			for( int i = 0; i < tableCount && 12 + 16 * (i + 1) <= (int) data.size(); i++) {
+				const unsigned char *pRecord = &data[ 12 + 16 * i];
+				uint32_t offset = readFontUint32( pRecord + 8);
+				uint32_t length = readFontUint32( pRecord + 12);
+				if( memcmp( pRecord, tag, 4) == 0 && offset + (uint64_t) length <= data.size() && length >= minimumLength) {
+					return &data[ offset];
+				}
+			}
+			return NULL;
+		}
+
+		// The Unicode character map, in format 4, which covers every character the game draws
+		const unsigned char *findCharacterMap()
+		{
+			int mapCount = readFontUint16( pCmap + 2);
+			for( int i = 0; i < mapCount; i++) {
+				const unsigned char *pRecord = pCmap + 4 + 8 * i;
+				int platform = readFontUint16( pRecord);
+				int encoding = readFontUint16( pRecord + 2);
+				const unsigned char *pMap = pCmap + readFontUint32( pRecord + 4);
+				if( (platform == 0 || (platform == 3 && encoding == 1)) && readFontUint16( pMap) == 4) {
+					return pMap;
+				}
+			}
+			return NULL;
+		}
+
+		int glyphIndex( unsigned int character)
+		{
+			int segmentCount = readFontUint16( pCharacterMap + 6) / 2;
+			const unsigned char *pEnds = pCharacterMap + 14;
+			const unsigned char *pStarts = pEnds + 2 * segmentCount + 2;
+			const unsigned char *pDeltas = pStarts + 2 * segmentCount;
+			const unsigned char *pRangeOffsets = pDeltas + 2 * segmentCount;
+			for( int i = 0; i < segmentCount; i++) {
+				if( character > (unsigned int) readFontUint16( pEnds + 2 * i)) {
+					continue;
+				}
+				unsigned int start = readFontUint16( pStarts + 2 * i);
+				if( character < start) {
+					return 0;
+				}
+				int delta = readFontUint16( pDeltas + 2 * i);
+				int rangeOffset = readFontUint16( pRangeOffsets + 2 * i);
+				if( rangeOffset == 0) {
+					return (character + delta) & 0xFFFF;
+				}
+				int glyph = readFontUint16( pRangeOffsets + 2 * i + rangeOffset + 2 * (character - start));
+				return (glyph == 0) ? 0 : (glyph + delta) & 0xFFFF;
+			}
+			return 0;
+		}
+
+		// Where a glyph's outline is in the glyf table, or NULL for a glyph with no outline
+		const unsigned char *findGlyph( int glyph)
+		{
+			if( glyph < 0 || glyph >= glyphCount) {
+				return NULL;
+			}
+			uint32_t start = longLoca ? readFontUint32( pLoca + 4 * glyph) : 2 * readFontUint16( pLoca + 2 * glyph);
+			uint32_t end = longLoca ? readFontUint32( pLoca + 4 * glyph + 4) : 2 * readFontUint16( pLoca + 2 * glyph + 2);
+			return (end > start) ? pGlyf + start : NULL;
+		}
+
+		// Add the edges of a glyph's outline, after the transform
+		//    x' = xx * x + yx * y + dx,   y' = xy * x + yy * y + dy
+		// from font units to pixels.  Composite glyphs add the outlines of their parts.
+		void addOutline( int glyph, const float transform[ 6], std::vector<OutlineEdge> &edges, int depth = 0)
+		{
+			const unsigned char *pGlyph = findGlyph( glyph);
+			if( pGlyph == NULL || depth > 8) {
+				return;
+			}
+			int contourCount = readFontInt16( pGlyph);
+			if( contourCount < 0) {
+				addCompositeOutline( pGlyph + 10, transform, edges, depth);
+				return;
+			}
+
+			// Simple glyph: contour end points, instructions (skipped), flags, then x and y deltas
+			const unsigned char *pEnds = pGlyph + 10;
+			int pointCount = (contourCount == 0) ? 0 : readFontUint16( pEnds + 2 * (contourCount - 1)) + 1;
+			const unsigned char *pFlags = pEnds + 2 * contourCount + 2 + readFontUint16( pEnds + 2 * contourCount);
+			std::vector<unsigned char> flags( pointCount);
+			for( int i = 0; i < pointCount; ) {
+				unsigned char flag = *pFlags++;
+				int repeat = (flag & 8) ? *pFlags++ : 0;
+				for( int r = 0; r <= repeat && i < pointCount; r++) {
+					flags[ i++] = flag;
+				}
+			}
+			std::vector<float> xs( pointCount);
+			std::vector<float> ys( pointCount);
+			const unsigned char *pCoordinates = pFlags;
+			int value = 0;
+			for( int i = 0; i < pointCount; i++) {
+				value += readCoordinate( pCoordinates, flags[ i], 2, 16);
+				xs[ i] = (float) value;
+			}
+			value = 0;
+			for( int i = 0; i < pointCount; i++) {
+				value += readCoordinate( pCoordinates, flags[ i], 4, 32);
+				ys[ i] = (float) value;
+			}
+			for( int i = 0; i < pointCount; i++) {
+				float x = xs[ i];
+				float y = ys[ i];
+				xs[ i] = transform[ 0] * x + transform[ 2] * y + transform[ 4];
+				ys[ i] = transform[ 1] * x + transform[ 3] * y + transform[ 5];
+			}
+
+			int first = 0;
+			for( int c = 0; c < contourCount; c++) {
+				int last = readFontUint16( pEnds + 2 * c);
+				addContour( &xs[ first], &ys[ first], &flags[ first], last - first + 1, edges);
+				first = last + 1;
+			}
+		}
+
+		// One coordinate delta: a byte whose sign comes from the flags, a repeat of the last
+		// value, or a 16-bit delta
+		int readCoordinate( const unsigned char* &pBytes, unsigned char flag, int shortBit, int sameBit)
+		{
+			if( flag & shortBit) {
+				int delta = *pBytes++;
+				return (flag & sameBit) ? delta : -delta;
+			}
+			if( flag & sameBit) {
+				return 0;
+			}
+			int delta = readFontInt16( pBytes);
+			pBytes += 2;
+			return delta;
+		}
+
+		void addCompositeOutline( const unsigned char *pComponent, const float transform[ 6],
+		                          std::vector<OutlineEdge> &edges, int depth)
+		{
+			const int WordArguments = 1, HaveScale = 8, MoreComponents = 0x20, HaveXYScale = 0x40, HaveTwoByTwo = 0x80;
+			int flags;
+			do {
+				flags = readFontUint16( pComponent);
+				int part = readFontUint16( pComponent + 2);
+				pComponent += 4;
+				float dx, dy;
+				if( flags & WordArguments) {
+					dx = readFontInt16( pComponent);
+					dy = readFontInt16( pComponent + 2);
+					pComponent += 4;
+				}
+				else {
+					dx = (signed char) pComponent[ 0];
+					dy = (signed char) pComponent[ 1];
+					pComponent += 2;
+				}
+				// Scales are 2.14 fixed point
+				float xx = 1, xy = 0, yx = 0, yy = 1;
+				if( flags & HaveScale) {
+					xx = yy = readFontInt16( pComponent) / 16384.0f;
+					pComponent += 2;
+				}
+				else if( flags & HaveXYScale) {
+					xx = readFontInt16( pComponent) / 16384.0f;
+					yy = readFontInt16( pComponent + 2) / 16384.0f;
+					pComponent += 4;
+				}
+				else if( flags & HaveTwoByTwo) {
+					xx = readFontInt16( pComponent) / 16384.0f;
+					xy = readFontInt16( pComponent + 2) / 16384.0f;
+					yx = readFontInt16( pComponent + 4) / 16384.0f;
+					yy = readFontInt16( pComponent + 6) / 16384.0f;
+					pComponent += 8;
+				}
+				// The part's own transform, followed by this glyph's
+				float combined[ 6] = {
+					transform[ 0] * xx + transform[ 2] * xy, transform[ 1] * xx + transform[ 3] * xy,
+					transform[ 0] * yx + transform[ 2] * yy, transform[ 1] * yx + transform[ 3] * yy,
+					transform[ 0] * dx + transform[ 2] * dy + transform[ 4], transform[ 1] * dx + transform[ 3] * dy + transform[ 5]
+				};
+				addOutline( part, combined, edges, depth + 1);
+			} while( flags & MoreComponents);
+		}
+
+		// Flatten one closed contour of quadratic curves into edges.  Between two points off
+		// the curve there is an implied point on it, halfway between them.
+		void addContour( const float xs[], const float ys[], const unsigned char flags[], int count,
+		                 std::vector<OutlineEdge> &edges)
+		{
+			const int CurveSteps = 6;
+			if( count < 2) {
+				return;
+			}
+			// Start from a point on the curve, or the midpoint of the first two if there is none
+			int start = 0;
+			while( start < count && !(flags[ start] & 1)) {
+				start++;
+			}
+			float startX, startY;
+			if( start == count) {
+				startX = (xs[ 0] + xs[ 1]) / 2;
+				startY = (ys[ 0] + ys[ 1]) / 2;
+				start = 0;
+			}
+			else {
+				startX = xs[ start];
+				startY = ys[ start];
+			}
+			float x = startX, y = startY;
+			bool haveControl = false;
+			float controlX = 0, controlY = 0;
+			for( int k = 1; k <= count; k++) {
+				int i = (start + k) % count;
+				bool onCurve = (flags[ i] & 1) != 0;
+				if( k == count && (flags[ start] & 1) == 0) {
+					onCurve = true;    // Close the contour back at the midpoint it started from
+				}
+				float pointX = (k == count) ? startX : xs[ i];
+				float pointY = (k == count) ? startY : ys[ i];
+				if( !onCurve) {
+					if( haveControl) {
+						float middleX = (controlX + pointX) / 2;
+						float middleY = (controlY + pointY) / 2;
+						addCurve( x, y, controlX, controlY, middleX, middleY, CurveSteps, edges);
+						x = middleX;
+						y = middleY;
+					}
+					controlX = pointX;
+					controlY = pointY;
+					haveControl = true;
+					continue;
+				}
+				if( haveControl) {
+					addCurve( x, y, controlX, controlY, pointX, pointY, CurveSteps, edges);
+				}
+				else {
+					addEdge( x, y, pointX, pointY, edges);
+				}
+				x = pointX;
+				y = pointY;
+				haveControl = false;
+			}
+			if( haveControl) {
+				addCurve( x, y, controlX, controlY, startX, startY, CurveSteps, edges);
+			}
+		}
+
+		void addCurve( float x0, float y0, float controlX, float controlY, float x1, float y1, int steps,
+		               std::vector<OutlineEdge> &edges)
+		{
+			float lastX = x0, lastY = y0;
+			for( int s = 1; s <= steps; s++) {
+				float t = (float) s / steps;
+				float u = 1 - t;
+				float x = u * u * x0 + 2 * u * t * controlX + t * t * x1;
+				float y = u * u * y0 + 2 * u * t * controlY + t * t * y1;
+				addEdge( lastX, lastY, x, y, edges);
+				lastX = x;
+				lastY = y;
+			}
+		}
+
+		void addEdge( float x0, float y0, float x1, float y1, std::vector<OutlineEdge> &edges)
+		{
+			if( y0 != y1) {
+				OutlineEdge edge = { x0, y0, x1, y1 };
+				edges.push_back( edge);
+			}
+		}
+
+		// Draw a glyph's outline, scaled from font units to pixels, into its coverage bitmap
+		void rasterize( int glyph, float scale, RasterGlyph &result)
+		{
+			const int Subrows = 4;
+			result.advance = readFontUint16( pHmtx + 4 * std::min( glyph, horizontalMetricCount - 1)) * scale;
+			result.left = result.top = result.width = result.height = 0;
+			const unsigned char *pGlyph = findGlyph( glyph);
+			if( pGlyph == NULL) {
+				return;
+			}
+			// Font units go up from the baseline, pixels go down
+			float transform[ 6] = { scale, 0, 0, -scale, 0, 0 };
+			std::vector<OutlineEdge> edges;
+			addOutline( glyph, transform, edges);
+			result.left = (int) floor( readFontInt16( pGlyph + 2) * scale);
+			result.top = (int) floor( -readFontInt16( pGlyph + 8) * scale);
+			result.width = (int) ceil( readFontInt16( pGlyph + 6) * scale) - result.left + 1;
+			result.height = (int) ceil( -readFontInt16( pGlyph + 4) * scale) - result.top + 1;
+			std::vector<float> coverage( result.width * result.height, 0.0f);
+
+			// For each scanline, find where the edges cross it and fill between the crossings
+			// where the winding number is not zero
+			std::vector<std::pair<float, int> > crossings;
+			for( int row = 0; row < result.height; row++) {
+				float *pRow = &coverage[ row * result.width];
+				for( int s = 0; s < Subrows; s++) {
+					float y = result.top + row + (s + 0.5f) / Subrows;
+					crossings.clear();
+					for( size_t e = 0; e < edges.size(); e++) {
+						const OutlineEdge &edge = edges[ e];
+						if( (y >= edge.y0) != (y >= edge.y1)) {
+							float x = edge.x0 + (y - edge.y0) * (edge.x1 - edge.x0) / (edge.y1 - edge.y0);
+							crossings.push_back( std::make_pair( x - result.left, (edge.y1 > edge.y0) ? 1 : -1));
+						}
+					}
+					std::sort( crossings.begin(), crossings.end());
+					int winding = 0;
+					for( size_t c = 0; c + 1 < crossings.size(); c++) {
+						winding += crossings[ c].second;
+						if( winding != 0) {
+							addSpan( pRow, result.width, crossings[ c].first, crossings[ c + 1].first, 1.0f / Subrows);
+						}
+					}
+				}
+			}
+			result.coverage.resize( coverage.size());
+			for( size_t i = 0; i < coverage.size(); i++) {
+				result.coverage[ i] = (unsigned char) (std::min( coverage[ i], 1.0f) * 255 + 0.5f);
+			}
+		}
+
+		// Add coverage for the part of a row from x0 to x1, counting partly covered pixels
+		// by how much of them is covered
+		void addSpan( float row[], int width, float x0, float x1, float amount)
+		{
+			x0 = std::max( x0, 0.0f);
+			x1 = std::min( x1, (float) width);
+			for( int x = (int) x0; x < x1; x++) {
+				row[ x] += amount * (std::min( x1, x + 1.0f) - std::max( x0, (float) x));
+			}
+		}
+
+		std::vector<unsigned char> data;           // The whole font file
+		const unsigned char *pCmap;
+		const unsigned char *pCharacterMap;
+		const unsigned char *pLoca;
+		const unsigned char *pGlyf;
+		const unsigned char *pHmtx;
+		int unitsPerEm;
+		bool longLoca;
+		int glyphCount;
+		int horizontalMetricCount;
+		std::map<uint64_t, RasterGlyph> glyphs;    // Keyed by size and character
+
+}; //end class SoftwareFont
+
+
+// An RGB image in memory, three bytes a pixel, row by row from the top
+class OffscreenCanvas {
+	public:
+		OffscreenCanvas( int theWidth, int theHeight)
+		{
+			width = theWidth;
+			height = theHeight;
+			pixels.resize( (size_t) width * height * 3);
+		}
+
+		int getWidth() { return width; }
+		int getHeight() { return height; }
+		const std::vector<unsigned char> &getPixels() { return pixels; }
+
+		void clear( const sf::Color &color) { fillRect( 0, 0, width, height, color); }
+
+		// Fill a rectangle, clipped to the canvas
+		void fillRect( int left, int top, int rectWidth, int rectHeight, const sf::Color &color)
+		{
+			int right = std::min( left + rectWidth, width);
+			int bottom = std::min( top + rectHeight, height);
+			for( int y = std::max( top, 0); y < bottom; y++) {
+				unsigned char *pPixel = &pixels[ ((size_t) y * width + std::max( left, 0)) * 3];
+				for( int x = std::max( left, 0); x < right; x++) {
+					*pPixel++ = color.r;
+					*pPixel++ = color.g;
+					*pPixel++ = color.b;
+				}
+			}
+		}
+
+		// Draw text placed as sf::Text places it: the baseline is characterSize below y
+		void drawText( SoftwareFont &font, const std::string &text, float x, float y, int characterSize,
+		               const sf::Color &color)
+		{
+			float penX = x;
+			int baseline = (int) floor( y + characterSize + 0.5f);
+			for( size_t i = 0; i < text.size(); i++) {
+				const RasterGlyph &glyph = font.getGlyph( (unsigned char) text[ i], characterSize);
+				blend( glyph, (int) floor( penX + 0.5f) + glyph.left, baseline + glyph.top, color);
+				penX += glyph.advance;
+			}
+		}
+
+	private:
+		void blend( const RasterGlyph &glyph, int left, int top, const sf::Color &color)
+		{
+			for( int row = 0; row < glyph.height; row++) {
+				int y = top + row;
+				if( y < 0 || y >= height) {
+					continue;
+				}
+				for( int column = 0; column < glyph.width; column++) {
+					int x = left + column;
+					int alpha = glyph.coverage[ row * glyph.width + column];
+					if( x < 0 || x >= width || alpha == 0) {
+						continue;
+					}
+					unsigned char *pPixel = &pixels[ ((size_t) y * width + x) * 3];
+					pPixel[ 0] += (color.r - pPixel[ 0]) * alpha / 255;
+					pPixel[ 1] += (color.g - pPixel[ 1]) * alpha / 255;
+					pPixel[ 2] += (color.b - pPixel[ 2]) * alpha / 255;
+				}
+			}
+		}
+
+		int width;
+		int height;
+		std::vector<unsigned char> pixels;
+
+}; //end class OffscreenCanvas
+
+
+// Draw the frame the window would show for this board, as RenderThread::drawFrame() does
+void drawBoardOffscreen( OffscreenCanvas &canvas, SoftwareFont &font, int board[], int squaresPerSide, int move)
+{
+    const int Size = 90;
+    const int TextSize = SquareTextSize;
+    const int LabelSize = 20;
+    canvas.clear( sf::Color::Black);
+    for( int i = 0; i < squaresPerSide; i++) {
+        for( int j = 0; j < squaresPerSide; j++) {
+            int xPosition = 90 * j + j * 10;
+            int yPosition = 90 * i + i * 10;
+            canvas.fillRect( xPosition, yPosition, Size, Size, sf::Color::Blue);
+            int value = board[ i * squaresPerSide + j];
+            if( value != 0) {
+                // Placed the same way as Square::displayText()
+                std::string text = std::to_string( value);
+                int textX = xPosition + (Size / 2) - ((int) text.size() * TextSize) / 2;
+                int textY = yPosition + (Size - TextSize) / 2;
+                canvas.drawText( font, text, textX + 5, textY - 5, TextSize, sf::Color( 255, 255, 255));
+            }
+        }
+    }
+    canvas.drawText( font, "Move " + std::to_string( move), 0, WindowYSize - LabelSize - 5, LabelSize,
+                     sf::Color( 255, 255, 255));
+}
+
+
+//---------------------------------------------------------------------------------------
+// PNG files, written without compression so that no library is needed: the image data is
+// wrapped in "stored" deflate blocks, which are just lengths and the bytes themselves.
+uint32_t updateCrc32( uint32_t crc, const unsigned char *pBytes, size_t length)
+{
+    static uint32_t table[ 256];
+    static bool haveTable = false;
+    if( !haveTable) {
+        for( uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for( int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            table[ i] = value;
+        }
+        haveTable = true;
+    }
+    crc = ~crc;
+    for( size_t i = 0; i < length; i++) {
+        crc = table[ (crc ^ pBytes[ i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void appendBigEndian( std::string &output, uint32_t value)
+{
+    for( int shift = 24; shift >= 0; shift -= 8) {
+        output += (char) ((value >> shift) & 0xFF);
+    }
+}
+
+// Add a chunk: its length, then its type and data, then a CRC of the type and data
+void appendPngChunk( std::string &output, const char *type, const std::string &data)
+{
+    appendBigEndian( output, (uint32_t) data.size());
+    size_t start = output.size();
+    output += type;
+    output += data;
+    appendBigEndian( output, updateCrc32( 0, (const unsigned char *) output.data() + start, output.size() - start));
+}
+
+// Build a PNG file of an RGB image in output, reusing its space
+void encodePng( const std::vector<unsigned char> &pixels, int width, int height, std::string &output)
+{
+    const size_t MaxStoredBlock = 65535;
+    std::string header;
+    appendBigEndian( header, width);
+    appendBigEndian( header, height);
+    header += std::string( "\x08\x02\x00\x00\x00", 5);   // 8 bits, RGB, no interlacing
+
+    // Each row starts with filter type 0 (none)
+    std::string raw;
+    raw.reserve( (size_t) height * (width * 3 + 1));
+    for( int y = 0; y < height; y++) {
+        raw += '\0';
+        raw.append( (const char *) &pixels[ (size_t) y * width * 3], (size_t) width * 3);
+    }
+    std::string compressed = "\x78\x01";               // zlib header: deflate, no preset dictionary
+    for( size_t start = 0; start < raw.size() || start == 0; start += MaxStoredBlock) {
+        size_t length = std::min( MaxStoredBlock, raw.size() - start);
+        bool last = (start + length == raw.size());
+        compressed += (char) (last ? 1 : 0);
+        compressed += (char) (length & 0xFF);
+        compressed += (char) (length >> 8);
+        compressed += (char) (~length & 0xFF);
+        compressed += (char) ((~length >> 8) & 0xFF);
+        compressed.append( raw, start, length);
+    }
+    // Adler-32 of the raw data.  The sums cannot overflow in 5552 bytes, so they are only
+    // reduced once per 5552 bytes rather than once per byte.
+    uint32_t a = 1, b = 0;
+    for( size_t start = 0; start < raw.size(); start += 5552) {
+        size_t end = std::min( raw.size(), start + 5552);
+        for( size_t i = start; i < end; i++) {
+            a += (unsigned char) raw[ i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    appendBigEndian( compressed, (b << 16) | a);
+
+    output.assign( "\x89PNG\r\n\x1a\n", 8);
+    appendPngChunk( output, "IHDR", header);
+    appendPngChunk( output, "IDAT", compressed);
+    appendPngChunk( output, "IEND", "");
+}
+
+
+//---------------------------------------------------------------------------------------
+// Export a game played from a script as frames, drawn offscreen.  One frame is drawn for
+// the starting board and one after each command, so a video runs one command per frame.
+// If output ends in .png, each frame is written to its own file, numbered, so frame.png
+// gives frame000000.png, frame000001.png and so on.  Otherwise the frames are written one
+// after another as raw 8-bit RGB video to the file (- for standard output, in which case
+// the text display goes to standard error), which ffmpeg can read using:
+//    ffmpeg -f rawvideo -pixel_format rgb24 -video_size 400x500 -framerate 30 -i <file> game.mp4
+// The time taken to draw and to write the frames is reported, which makes this a render
+// benchmark that needs no display.
+// Run it using:   ./sfml-app --export <script, or - for stdin> <output> [seed]
+void runExport( const char *scriptName, const char *output, unsigned int seed)
+{
+    SoftwareFont font;
+    if( !font.loadFromMemory( embeddedFontStart, embeddedFontSize())) {
+        std::cout << "Unable to load font. " << std::endl;
+        return;
+    }
+    std::string prefix = output;
+    bool pngFrames = prefix.size() > 4 && prefix.compare( prefix.size() - 4, 4, ".png") == 0;
+    prefix = pngFrames ? prefix.substr( 0, prefix.size() - 4) : prefix;
+    FILE *pVideo = NULL;
+    if( !pngFrames) {
+        if( strcmp( output, "-") == 0) {
+            // Keep the real standard output for the video, and send the text to standard error
+            pVideo = fdopen( dup( STDOUT_FILENO), "wb");
+            dup2( STDERR_FILENO, STDOUT_FILENO);
+        }
+        else {
+            pVideo = fopen( output, "wb");
+        }
+        if( pVideo == NULL) {
+            std::cout << "Could not open " << output << std::endl;
+            return;
+        }
+    }
+
+    OffscreenCanvas canvas( WindowXSize, WindowYSize);
+    std::string png;
+    long long frames = 0;
+    long long bytes = 0;
+    double drawMilliseconds = 0;
+    double writeMilliseconds = 0;
+    bool failed = false;
+    runScript( scriptName, 0, seed, [&]( int board[], int squaresPerSide, int move) {
+        if( failed) {
+            return;
+        }
+        std::chrono::steady_clock::time_point drawStart = std::chrono::steady_clock::now();
+        drawBoardOffscreen( canvas, font, board, squaresPerSide, move);
+        std::chrono::steady_clock::time_point writeStart = std::chrono::steady_clock::now();
+        drawMilliseconds += millisecondsSince( drawStart);
+        if( pngFrames) {
+            encodePng( canvas.getPixels(), canvas.getWidth(), canvas.getHeight(), png);
+            char number[ 16];
+            snprintf( number, sizeof( number), "%06lld", frames);
+            FILE *pFile = fopen( (prefix + number + ".png").c_str(), "wb");
+            failed = (pFile == NULL) || fwrite( png.data(), 1, png.size(), pFile) != png.size();
+            if( pFile != NULL) {
+                fclose( pFile);
+            }
+            bytes += png.size();
+        }
+        else {
+            const std::vector<unsigned char> &pixels = canvas.getPixels();
+            failed = fwrite( &pixels[ 0], 1, pixels.size(), pVideo) != pixels.size();
+            bytes += pixels.size();
+        }
+        writeMilliseconds += millisecondsSince( writeStart);
+        frames++;
+    });
+    if( pVideo != NULL) {
+        failed = (fclose( pVideo) != 0) || failed;
+    }
+    if( failed) {
+        std::cout << "Could not write " << output << std::endl;
+    }
+    std::cout << frames << " frames of " << WindowXSize << "x" << WindowYSize << ", " << bytes / 1048576.0 << " MB: "
+              << drawMilliseconds / std::max( frames, 1LL) << " ms to draw and "
+              << writeMilliseconds / std::max( frames, 1LL) << " ms to write each frame" << std::endl;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Game server, for bots and test harnesses that want many games at once from one process.
+// Clients connect to a Unix domain socket (or a TCP port on the loopback address) and each
+// connection plays its own game.  Each line sent is a command, answered by one line:
+//     w a s d       make a move             u y     undo or redo a move
+//     r <size>      start a new game        q       close the connection
+// The answer is "ok <move> <score> <over> <size> <squares...>", with over 1 when no move is
+// possible, or "error <reason>".  Bots can instead send binary batches, described below.
+// Moves use makeFastMove(), which gives the same boards and scores as movePieces() and
+// combine().  After 'q', or when the client closes its side, the answers already due are
+// still sent before the connection is closed.  A connection is closed straight away if it
+// sends a line longer than MaxLineLength, or keeps sending while more than MaxPendingOutput
+// of its answers wait unread.
+// A few worker threads share the connections, each waiting on its own epoll set, so
+// thousands of mostly idle games cost no threads of their own.
+// Run it using:   ./sfml-app --serve <socket path, or port number> [threads]
+#if defined(__linux__)
+
+struct ServerGame {
+    int board[ MaxBoardSize * MaxBoardSize];
+    int squaresPerSide;
+    int move;
+    int score;
+    Timeline timeline;
+    FastRandom random;
+};
+
+// Start a new game of the given size with two random pieces, just like the interactive game
+void startServerGame( ServerGame &game, int squaresPerSide)
+{
+    game.squaresPerSide = squaresPerSide;
+    game.move = 1;
+    game.score = 0;
+    resetBoard( game.board, squaresPerSide);
+    placeRandomFast( game.board, squaresPerSide, game.random);
+    placeRandomFast( game.board, squaresPerSide, game.random);
+    game.timeline = Timeline();
+    game.timeline.record( squaresPerSide, game.board, game.move, game.score);
+}
+
+// Make a move ('W', 'A', 'S' or 'D'), undo ('U') or redo ('Y').  Returns false if the
+// command did nothing.
+bool playServerCommand( ServerGame &game, char command)
+{
+    if( command == 'U') {
+        return game.timeline.undo( game.squaresPerSide, game.board, game.move, game.score);
+    }
+    if( command == 'Y') {
+        return game.timeline.redo( game.squaresPerSide, game.board, game.move, game.score);
+    }
+    if( !makeFastMove( game.board, command, game.squaresPerSide, game.score)) {
+        return false;
+    }
+    placeRandomFast( game.board, game.squaresPerSide, game.random);
+    game.move++;
+    game.timeline.record( game.squaresPerSide, game.board, game.move, game.score);
+    return true;
+}
+
+struct ServerConnection {
+    int socket;
+    size_t index;            // Position in its worker's list of connections
+    std::string input;       // Received, up to the end of the last complete command
+    std::string output;      // Waiting to be sent
+    size_t outputSent;       // Bytes of output already sent
+    bool waitingToWrite;     // Registered for EPOLLOUT because the socket was full
+    bool closing;            // No more input is read; closed once the output is sent
+    std::vector<ServerGame *> games;   // Game 0 is played by text commands
+
+    ~ServerConnection()
+    {
+        for( size_t i = 0; i < games.size(); i++) {
+            delete games[ i];
+        }
+    }
+};
+
+// Each worker's counters, on their own cache line so workers do not slow each other down
+struct alignas( 64) ServerCounters {
+    std::atomic<long long> commands;
+    std::atomic<long long> latencyNanoseconds;   // Summed over commands
+    std::atomic<long long> maxLatencyNanoseconds;
+    std::atomic<int> sessions;
+    std::atomic<long long> cpuNanoseconds;       // Thread CPU time, updated by the worker
+
+    ServerCounters() : commands( 0), latencyNanoseconds( 0), maxLatencyNanoseconds( 0), sessions( 0),
+                       cpuNanoseconds( 0) {}
+};
+
+volatile sig_atomic_t serverStopping = 0;
+
+void stopServer( int)
+{
+    serverStopping = 1;
+}
+
+// Binary batches, for bots driving many games at once.  One message carries moves for any
+// number of the connection's games, and one message comes back, so a batch of moves costs
+// one read and one write in total.  A message starts with BinaryMagic, which no text command
+// does, so both kinds can be sent on the same connection.  All numbers are little-endian.
+// Request:   magic (1 byte), version (1), count (2), then count entries of 8 bytes:
+//            game (4), command (1: 'W' 'A' 'S' 'D' 'U' 'Y', or 'N' for a new game),
+//            size for 'N' (1), unused (2)
+// Response:  magic (1), version (1), count (2), then for each entry:
+//            game (4), score change (4, signed), move (4), flags (1), size (1), unused (2),
+//            then size * size bytes, the exponent of each square (0 for empty, 1 for 2, ...)
+// Games are numbered by the client from 0 up to MaxServerGames-1, and start as 4x4 games the
+// first time they are used; game 0 is also the one played by text commands.  The flags are
+// BinaryChanged, BinaryGameOver and BinaryError.  Every entry of a message with the wrong
+// version, or for a game number out of range, gets just BinaryError back.
+const unsigned char BinaryMagic = 0xB1;
+const unsigned char BinaryVersion = 1;
+const int BinaryHeaderSize = 4;
+const int BinaryEntrySize = 8;
+const unsigned int MaxServerGames = 1024;      // Per connection, each with its own Timeline
+const unsigned char BinaryChanged = 1;
+const unsigned char BinaryGameOver = 2;
+const unsigned char BinaryError = 4;
+
+// What one connection may make its worker hold or spend.  Reading stops after MaxReadPerEvent
+// bytes, so a client that sends without pause cannot keep its worker from the others, and
+// commands are only answered while less than MaxPendingOutput is waiting to be sent.
+const size_t MaxReadPerEvent = 256 * 1024;
+const size_t MaxLineLength = 4096;
+const size_t MaxPendingOutput = 16 * 1024 * 1024;    // More than the answer to the largest batch
+
+void appendLittleEndian( std::string &output, uint32_t value, int bytes)
+{
+    for( int i = 0; i < bytes; i++) {
+        output += (char)( value >> (8 * i));
+    }
+}
+
+uint32_t readLittleEndian( const unsigned char *pBytes, int bytes)
+{
+    uint32_t value = 0;
+    for( int i = 0; i < bytes; i++) {
+        value |= (uint32_t) pBytes[ i] << (8 * i);
+    }
+    return value;
+}
+
+// Answer the binary batch starting at start in the connection's input, returning the number
+// of bytes it took, or 0 if it has not all arrived yet.  commands is set to its entry count.
+size_t handleBinaryBatch( ServerConnection &connection, size_t start, int &commands)
+{
+    const unsigned char *pMessage = (const unsigned char *) connection.input.data() + start;
+    size_t available = connection.input.size() - start;
+    if( available < (size_t) BinaryHeaderSize) {
+        return 0;
+    }
+    int count = (int) readLittleEndian( pMessage + 2, 2);
+    size_t size = BinaryHeaderSize + (size_t) count * BinaryEntrySize;
+    if( available < size) {
+        return 0;
+    }
+    commands = count;
+
+    connection.output += (char) BinaryMagic;
+    connection.output += (char) BinaryVersion;
+    appendLittleEndian( connection.output, count, 2);
+    bool knownVersion = (pMessage[ 1] == BinaryVersion);
+    for( int e = 0; e < count; e++) {
+        const unsigned char *pEntry = pMessage + BinaryHeaderSize + (size_t) e * BinaryEntrySize;
+        uint32_t gameNumber = readLittleEndian( pEntry, 4);
+        char command = pEntry[ 4];
+        int newSize = pEntry[ 5];
+
+        unsigned char flags = 0;
+        ServerGame *pGame = NULL;
+        if( !knownVersion || gameNumber >= MaxServerGames) {
+            flags = BinaryError;
+        }
+        else {
+            while( connection.games.size() <= gameNumber) {
+                ServerGame *pNewGame = new ServerGame;
+                pNewGame->random = FastRandom( connection.games[ 0]->random.next());
+                startServerGame( *pNewGame, 4);
+                connection.games.push_back( pNewGame);
+            }
+            pGame = connection.games[ gameNumber];
+        }
+
+        int scoreBefore = 0;
+        if( pGame != NULL) {
+            scoreBefore = pGame->score;
+            if( command == 'N' && newSize >= 4 && newSize <= MaxBoardSize) {
+                startServerGame( *pGame, newSize);
+                flags |= BinaryChanged;
+                scoreBefore = 0;
+            }
+            else if( command != 'N' && command != '\0' && strchr( "WASDUY", command) != NULL) {
+                if( playServerCommand( *pGame, command)) {
+                    flags |= BinaryChanged;
+                }
+            }
+            else {
+                flags |= BinaryError;
+            }
+        }
+
+        appendLittleEndian( connection.output, gameNumber, 4);
+        if( pGame == NULL) {
+            appendLittleEndian( connection.output, 0, 4);
+            appendLittleEndian( connection.output, 0, 4);
+            connection.output += (char) flags;
+            appendLittleEndian( connection.output, 0, 3);
+            continue;
+        }
+        if( boardFull( pGame->board, pGame->squaresPerSide)) {
+            flags |= BinaryGameOver;
+        }
+        appendLittleEndian( connection.output, (uint32_t)( pGame->score - scoreBefore), 4);
+        appendLittleEndian( connection.output, pGame->move, 4);
+        connection.output += (char) flags;
+        connection.output += (char) pGame->squaresPerSide;
+        appendLittleEndian( connection.output, 0, 2);
+        unsigned char exponents[ MaxBoardSize * MaxBoardSize];
+        boardToExponents( pGame->board, exponents, pGame->squaresPerSide);
+        connection.output.append( (const char *) exponents, pGame->squaresPerSide * pGame->squaresPerSide);
+    }
+    return size;
+}
+
+// Answer every complete line and binary batch in the connection's input
+int handleServerInput( ServerConnection &connection)
+{
+    TRACE_SCOPE( "server commands");
+    int commands = 0;
+    size_t lineStart = 0;
+    size_t lineEnd;
+    while( lineStart < connection.input.size() && connection.output.size() < MaxPendingOutput) {
+        if( (unsigned char) connection.input[ lineStart] == BinaryMagic) {
+            int batchCommands = 0;
+            size_t batchSize = handleBinaryBatch( connection, lineStart, batchCommands);
+            if( batchSize == 0) {
+                break;
+            }
+            lineStart += batchSize;
+            commands += batchCommands;
+            continue;
+        }
+        if( (lineEnd = connection.input.find( '\n', lineStart)) == std::string::npos) {
+            break;
+        }
+        const char *pLine = connection.input.c_str() + lineStart;
+        while( *pLine == ' ' || *pLine == '\t') {
+            pLine++;
+        }
+        char command = toupper( *pLine);
+        lineStart = lineEnd + 1;
+        commands++;
+
+        ServerGame &game = *connection.games[ 0];
+        if( command == 'Q') {
+            connection.output += "ok bye\n";
+            return -1;
+        }
+        else if( command == 'R') {
+            int squaresPerSide = atoi( pLine + 1);
+            if( squaresPerSide < 4 || squaresPerSide > MaxBoardSize) {
+                connection.output += "error size must be 4 to " + std::to_string( MaxBoardSize) + "\n";
+                continue;
+            }
+            startServerGame( game, squaresPerSide);
+        }
+        else if( command != '\0' && strchr( "WASDUY", command) != NULL) {
+            playServerCommand( game, command);
+        }
+        else {
+            connection.output += "error unknown command\n";
+            continue;
+        }
+
+        char number[ 16];
+        connection.output += "ok ";
+        connection.output += std::to_string( game.move) + " " + std::to_string( game.score) + " ";
+        connection.output += boardFull( game.board, game.squaresPerSide) ? "1 " : "0 ";
+        connection.output += std::to_string( game.squaresPerSide);
+        for( int i = 0; i < game.squaresPerSide * game.squaresPerSide; i++) {
+            int length = snprintf( number, sizeof( number), " %d", game.board[ i]);
+            connection.output.append( number, length);
+        }
+        connection.output += "\n";
+    }
+    connection.input.erase( 0, lineStart);
+    return commands;
+}
+
+// True if the connection's input ends in a line too long to wait for the rest of.  A binary
+// batch still arriving is limited by its count, so it never is.
+bool pendingLineTooLong( ServerConnection &connection)
+{
+    return connection.input.size() > MaxLineLength && (unsigned char) connection.input[ 0] != BinaryMagic
+           && connection.input.find( '\n') == std::string::npos;
+}
+
+// Send as much waiting output as the socket takes.  Returns false if the connection failed.
+bool flushServerOutput( ServerConnection &connection)
+{
+    while( connection.outputSent < connection.output.size()) {
+        ssize_t sent = send( connection.socket, connection.output.data() + connection.outputSent,
+                             connection.output.size() - connection.outputSent, MSG_NOSIGNAL);
+        if( sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        connection.outputSent += sent;
+    }
+    connection.output.clear();
+    connection.outputSent = 0;
+    return true;
+}
+
+long long threadCpuNanoseconds()
+{
+    timespec now;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void serverWorker( int worker, int listenSocket, ServerCounters *pCounters)
+{
+    int epollSocket = epoll_create1( 0);
+    epoll_event event;
+    // With EPOLLEXCLUSIVE only one waiting worker is woken for each new client
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.ptr = NULL;
+    epoll_ctl( epollSocket, EPOLL_CTL_ADD, listenSocket, &event);
+
+    std::vector<ServerConnection *> connections;
+    FastRandom seeds( (uint64_t) time( NULL) * (worker + 1));
+    const int MaxEvents = 256;
+    epoll_event events[ MaxEvents];
+    char buffer[ 64 * 1024];
+
+    while( !serverStopping) {
+        int eventCount = epoll_wait( epollSocket, events, MaxEvents, 200);
+        for( int e = 0; e < eventCount; e++) {
+            ServerConnection *pConnection = (ServerConnection *) events[ e].data.ptr;
+            if( pConnection == NULL) {
+                // New clients
+                int clientSocket;
+                while( (clientSocket = accept4( listenSocket, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+                    pConnection = new ServerConnection;
+                    pConnection->socket = clientSocket;
+                    pConnection->outputSent = 0;
+                    pConnection->waitingToWrite = false;
+                    pConnection->closing = false;
+                    pConnection->games.push_back( new ServerGame);
+                    pConnection->games[ 0]->random = FastRandom( seeds.next());
+                    startServerGame( *pConnection->games[ 0], 4);
+                    pConnection->index = connections.size();
+                    connections.push_back( pConnection);
+                    event.events = EPOLLIN | EPOLLRDHUP;
+                    event.data.ptr = pConnection;
+                    epoll_ctl( epollSocket, EPOLL_CTL_ADD, clientSocket, &event);
+                    pCounters->sessions.fetch_add( 1, std::memory_order_relaxed);
+                }
+                continue;
+            }
+
+            bool keep = (events[ e].events & (EPOLLERR | EPOLLHUP)) == 0;
+            bool finished = false;     // Nothing more to read: close once the answers are sent
+            bool wasClosing = pConnection->closing;
+            int commands = 0;
+            std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+            if( keep && !pConnection->closing && (events[ e].events & (EPOLLIN | EPOLLRDHUP))) {
+                if( pConnection->output.size() >= MaxPendingOutput) {
+                    keep = false;      // Still sending, but not reading its answers
+                }
+                else {
+                    ssize_t length = 0;
+                    size_t bytesRead = 0;
+                    while( bytesRead < MaxReadPerEvent
+                           && (length = recv( pConnection->socket, buffer, sizeof( buffer), 0)) > 0) {
+                        pConnection->input.append( buffer, length);
+                        bytesRead += length;
+                    }
+                    if( length == 0) {
+                        finished = true;   // Closed by the client, though any complete lines are still answered
+                    }
+                    else if( length < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                        keep = false;
+                    }
+                }
+            }
+            // Answer what has arrived, again whenever all the answers could be sent at once, in
+            // case answering stopped at MaxPendingOutput
+            while( keep && !pConnection->closing && !pConnection->input.empty()) {
+                int handled = handleServerInput( *pConnection);
+                if( handled < 0) {
+                    finished = true;
+                    commands++;
+                    break;
+                }
+                commands += handled;
+                if( handled == 0 || !flushServerOutput( *pConnection) || !pConnection->output.empty()) {
+                    break;
+                }
+            }
+            if( keep && pendingLineTooLong( *pConnection)) {
+                keep = false;
+            }
+            if( keep && !flushServerOutput( *pConnection)) {
+                keep = false;
+            }
+            if( keep && (finished || pConnection->closing)) {
+                if( pConnection->output.empty()) {
+                    keep = false;
+                }
+                else if( !pConnection->closing) {
+                    shutdown( pConnection->socket, SHUT_RD);
+                    pConnection->closing = true;
+                }
+            }
+            if( commands > 0) {
+                long long latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - received).count();
+                pCounters->commands.fetch_add( commands, std::memory_order_relaxed);
+                pCounters->latencyNanoseconds.fetch_add( latency * commands, std::memory_order_relaxed);
+                if( latency > pCounters->maxLatencyNanoseconds.load( std::memory_order_relaxed)) {
+                    pCounters->maxLatencyNanoseconds.store( latency, std::memory_order_relaxed);
+                }
+            }
+
+            if( !keep) {
+                epoll_ctl( epollSocket, EPOLL_CTL_DEL, pConnection->socket, NULL);
+                close( pConnection->socket);
+                connections.back()->index = pConnection->index;
+                connections[ pConnection->index] = connections.back();
+                connections.pop_back();
+                delete pConnection;
+                pCounters->sessions.fetch_sub( 1, std::memory_order_relaxed);
+            }
+            else if( pConnection->output.empty() == pConnection->waitingToWrite || pConnection->closing != wasClosing) {
+                // Only ask to hear about room to write while there is output left over, and
+                // only about that once the connection is closing
+                pConnection->waitingToWrite = !pConnection->output.empty();
+                event.events = pConnection->closing ? (uint32_t) EPOLLOUT
+                               : EPOLLIN | EPOLLRDHUP | (pConnection->waitingToWrite ? (uint32_t) EPOLLOUT : 0u);
+                event.data.ptr = pConnection;
+                epoll_ctl( epollSocket, EPOLL_CTL_MOD, pConnection->socket, &event);
+            }
+        }
+        pCounters->cpuNanoseconds.store( threadCpuNanoseconds(), std::memory_order_relaxed);
+    }
+
+    for( size_t i = 0; i < connections.size(); i++) {
+        close( connections[ i]->socket);
+        delete connections[ i];
+    }
+    close( epollSocket);
+}
+
+// Listen on a Unix domain socket, or on the loopback address when address is a port number
+int openServerSocket( const char *address)
+{
+    int listenSocket;
+    bool isPort = address[ 0] != '\0' && strspn( address, "0123456789") == strlen( address);
+    if( isPort) {
+        listenSocket = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int on = 1;
+        setsockopt( listenSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on));
+        sockaddr_in socketAddress;
+        memset( &socketAddress, 0, sizeof( socketAddress));
+        socketAddress.sin_family = AF_INET;
+        socketAddress.sin_port = htons( atoi( address));
+        socketAddress.sin_addr.s_addr = htonl( INADDR_LOOPBACK);
+        if( bind( listenSocket, (sockaddr *) &socketAddress, sizeof( socketAddress)) != 0) {
+            close( listenSocket);
+            return -1;
+        }
+    }
+    else {
+        listenSocket = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        sockaddr_un socketAddress;
+        memset( &socketAddress, 0, sizeof( socketAddress));
+        socketAddress.sun_family = AF_UNIX;
+        strncpy( socketAddress.sun_path, address, sizeof( socketAddress.sun_path) - 1);
+        unlink( address);
+        if( bind( listenSocket, (sockaddr *) &socketAddress, sizeof( socketAddress)) != 0) {
+            close( listenSocket);
+            return -1;
+        }
+    }
+    if( listen( listenSocket, SOMAXCONN) != 0) {
+        close( listenSocket);
+        return -1;
+    }
+    return listenSocket;
+}
+
+void runServer( const char *address, int threadCount)
+{
+    int listenSocket = openServerSocket( address);
+    if( listenSocket < 0) {
+        std::cout << "Could not listen on " << address << ": " << strerror( errno) << std::endl;
+        return;
+    }
+    threadCount = std::max( 1, threadCount);
+    signal( SIGINT, stopServer);
+    signal( SIGTERM, stopServer);
+    std::cout << "Serving games on " << address << " with " << threadCount
+              << " threads.  Press Ctrl-C to stop." << std::endl;
+
+    std::vector<ServerCounters> counters( threadCount);
+    std::vector<std::thread> threads;
+    for( int t = 0; t < threadCount; t++) {
+        threads.push_back( std::thread( serverWorker, t, listenSocket, &counters[ t]));
+    }
+
+    // Report every few seconds.  Sessions per core is the sessions that one fully busy core
+    // could serve at the current rate of commands.
+    const int ReportSeconds = 5;
+    long long lastCommands = 0;
+    long long lastLatency = 0;
+    long long lastCpu = 0;
+    std::chrono::steady_clock::time_point lastReport = std::chrono::steady_clock::now();
+    while( !serverStopping) {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 100));
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>( now - lastReport).count();
+        if( seconds < ReportSeconds && !serverStopping) {
+            continue;
+        }
+        long long commands = 0, latency = 0, maxLatency = 0, cpu = 0;
+        int sessions = 0;
+        for( int t = 0; t < threadCount; t++) {
+            commands += counters[ t].commands.load( std::memory_order_relaxed);
+            latency += counters[ t].latencyNanoseconds.load( std::memory_order_relaxed);
+            maxLatency = std::max( maxLatency, counters[ t].maxLatencyNanoseconds.exchange( 0, std::memory_order_relaxed));
+            cpu += counters[ t].cpuNanoseconds.load( std::memory_order_relaxed);
+            sessions += counters[ t].sessions.load( std::memory_order_relaxed);
+        }
+        long long newCommands = commands - lastCommands;
+        double coresBusy = (cpu - lastCpu) / 1e9 / seconds;
+        std::cout << sessions << " sessions, " << newCommands / seconds << " commands per second, "
+                  << (newCommands > 0 ? (latency - lastLatency) / 1000.0 / newCommands : 0.0) << " us mean and "
+                  << maxLatency / 1000.0 << " us max latency, " << coresBusy << " cores busy";
+        if( coresBusy > 0.01) {
+            std::cout << ", " << sessions / coresBusy << " sessions per core";
+        }
+        std::cout << std::endl;
+        lastCommands = commands;
+        lastLatency = latency;
+        lastCpu = cpu;
+        lastReport = now;
+    }
+
+    for( size_t t = 0; t < threads.size(); t++) {
+        threads[ t].join();
+    }
+    close( listenSocket);
+    if( strspn( address, "0123456789") != strlen( address)) {
+        unlink( address);
+    }
+}
+
+#else
+
+void runServer( const char *address, int threadCount)
+{
+    std::cout << "The game server needs Linux (epoll)." << std::endl;
+}
+
+#endif
+
+//---------------------------------------------------------------------------------------
+// Many-game simulation kernel.
+// To measure spawn rules and board sizes we need millions of games, so SimLanes games are
+// advanced together.  Boards are stored "structure of arrays" style: each square of the
+// board is a vector holding that square's exponent in every game, so one vector
+// instruction works on a whole group of games at once, each SIMD lane being a different
+// game.  The vectors use the compiler's vector extensions, which become SSE or AVX
+// instructions without depending on the optimizer to find them.
+// Each step, every game checks which moves would change its board, picks one with its own
+// random numbers, and has its board turned (by selecting squares, not branching) so that
+// its chosen move slides towards the start of each row.  All the games then slide together
+// and are turned back.  Moves and random numbers follow playRandomMove() exactly, so every
+// game ends with the same board and score as it would have in the scalar engine.
+// Both engines take the rules as a template parameter (see ClassicRules), and the batched
+// engine keeps each square as the rules' tile code.
+#ifdef __AVX2__
+const int SimLanes = 32;   // One 256-bit AVX2 register of games
+#else
+const int SimLanes = 16;   // One 128-bit SSE register of games
+#endif
+typedef unsigned char SimVector __attribute__(( vector_size( SimLanes)));
+// 64 bits per game, for the games' points and random number generators, and the lanes used
+// while drawing random numbers
+typedef uint64_t SimWideVector __attribute__(( vector_size( SimLanes * 8)));
+typedef uint16_t SimHalfVector __attribute__(( vector_size( SimLanes * 2)));
+typedef int32_t SimIntVector __attribute__(( vector_size( SimLanes * 4)));
+typedef double SimDoubleVector __attribute__(( vector_size( SimLanes * 8)));
+
+struct SimulationResult {
+    long long score;
+    int moves;
+    unsigned char codes[ MaxBoardSize * MaxBoardSize];   // Final board, as tile codes of the rules
+};
+
+
+//---------------------------------------------------------------------------------------
+// Widen every lane to 32 or 64 bits, or narrow it back.  These go a step at a time because
+// GCC turns a conversion straight between 8 and 64 bits into one instruction per lane.  The
+// wide vectors are passed by reference, since returning one larger than the machine's
+// registers by value changes the calling convention between instruction sets.
+void widenToInt( SimVector v, SimIntVector &wide)
+{
+    wide = __builtin_convertvector( __builtin_convertvector( v, SimHalfVector), SimIntVector);
+}
+
+void widenToWide( SimVector v, SimWideVector &wide)
+{
+    SimIntVector half;
+    widenToInt( v, half);
+    wide = __builtin_convertvector( half, SimWideVector);
+}
+
+SimVector narrowToLanes( const SimIntVector &v)
+{
+    return __builtin_convertvector( __builtin_convertvector( v, SimHalfVector), SimVector);
+}
+
+
+//---------------------------------------------------------------------------------------
+// True if any lane of a vector is non-zero.
+bool anyLane( SimVector v)
+{
+    uint64_t parts[ SimLanes / 8];
+    memcpy( parts, &v, sizeof( parts));
+    uint64_t combined = 0;
+    for( int i = 0; i < SimLanes / 8; i++) {
+        combined |= parts[ i];
+    }
+    return combined != 0;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Slide one line of every game towards the start of the line, in a single pass over the
+// line that works the same way as slideLine(): each lane keeps its own tile waiting to be
+// combined and its own count of tiles written so far.  Since lanes write to different
+// squares, a tile is written by offering it to every square it could land in, and only the
+// square matching that lane's count keeps it.
+template <typename Rules = ClassicRules>
+void slideLanes( SimVector line[], int length, SimWideVector &points)
+{
+    const SimVector zero = {};
+    SimVector result[ MaxBoardSize];
+    SimVector pending = zero;   // Tile waiting to see if the next tile combines with it
+    SimVector count = zero;     // Number of tiles written so far
+
+    for( int i = 0; i < length; i++) {
+        result[ i] = zero;
+    }
+    for( int i = 0; i < length; i++) {
+        SimVector tile = line[ i];
+        SimVector present = (SimVector)( tile != zero);
+        SimVector havePending = (SimVector)( pending != zero);
+        SimVector merge = present & havePending & Rules::canMergeCodes( pending, tile);
+        // Write the pending tile, combined if this tile matches it, when a tile arrives
+        SimVector write = present & havePending;
+        SimVector value = (Rules::mergeCodes( pending, tile) & merge) | (pending & ~merge);
+        if( anyLane( write)) {
+            for( int o = 0; o <= i; o++) {
+                result[ o] |= value & write & (SimVector)( count == (zero + (unsigned char) o));
+            }
+            count -= write;   // write lanes are all ones, i.e. -1, so this adds 1
+        }
+        if( anyLane( merge)) {
+            SimWideVector codes;
+            widenToWide( value & merge, codes);
+            Rules::addTileValues( codes, points);
+        }
+        // A combined tile leaves nothing pending; otherwise the new tile waits its turn
+        pending = (tile & ~merge) | (pending & ~present);
+    }
+    // Write the last pending tile
+    SimVector write = (SimVector)( pending != zero);
+    for( int o = 0; o < length; o++) {
+        result[ o] |= pending & write & (SimVector)( count == (zero + (unsigned char) o));
+    }
+    for( int i = 0; i < length; i++) {
+        line[ i] = result[ i];
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Place a random piece in one game of a group, with the same random numbers as
+// placeRandomFast().
+template <typename Rules = ClassicRules>
+void placeRandomLane( SimVector cells[], int squareCount, int lane, FastRandom &random)
+{
+    int emptyCount = 0;
+    for( int i = 0; i < squareCount; i++) {
+        emptyCount += (cells[ i][ lane] == 0);
+    }
+    if( emptyCount == 0) {
+        return;
+    }
+    unsigned char code = Rules::tileCode( Rules::spawnValue( random.nextInt( Rules::SpawnOutOf)));
+    int target = random.nextInt( emptyCount);
+    for( int i = 0; ; i++) {
+        if( cells[ i][ lane] == 0 && target-- == 0) {
+            cells[ i][ lane] = code;
+            return;
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Draw FastRandom::nextInt( limit) in every lane selected by mask, each lane from its own
+// generator and with its own limit (from 1 to 255), leaving the other lanes' generators
+// alone.  The remainder is found through doubles: the drawn number is below 2^31 and the
+// limit small, so the quotient is never close enough to a whole number to round up to it,
+// and every lane gets exactly what nextInt() would have given it.
+SimVector nextIntLanes( SimWideVector &state, SimVector mask, SimVector limit)
+{
+    SimWideVector select;
+    widenToWide( mask & (unsigned char) 1, select);
+    select = -select;   // All ones in the lanes of mask
+    SimWideVector s = state;
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    state = (s & select) | (state & ~select);
+
+    SimIntVector drawn = __builtin_convertvector( (s * 2685821657736338717ULL) >> 33, SimIntVector);
+    SimIntVector divisor;
+    widenToInt( limit | ((SimVector)( limit == 0) & (unsigned char) 1), divisor);
+    SimIntVector quotient = __builtin_convertvector( __builtin_convertvector( drawn, SimDoubleVector)
+                                                     / __builtin_convertvector( divisor, SimDoubleVector), SimIntVector);
+    return narrowToLanes( drawn - quotient * divisor) & mask;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Place a random piece in every game of a group selected by moved, with the same random
+// numbers as placeRandomFast().  Open squares are counted, the random numbers drawn and the
+// target square found for all games at once.
+template <typename Rules = ClassicRules>
+void placeRandomLanes( SimVector cells[], int squareCount, SimVector moved, SimWideVector &randomState)
+{
+    const SimVector zero = {};
+    SimVector emptyCount = zero;
+    for( int i = 0; i < squareCount; i++) {
+        emptyCount -= (SimVector)( cells[ i] == zero);
+    }
+
+    SimVector placing = moved & (SimVector)( emptyCount != zero);
+    SimVector roll = nextIntLanes( randomState, placing, zero + (unsigned char) Rules::SpawnOutOf);
+    SimVector target = nextIntLanes( randomState, placing, emptyCount);
+    SimVector code = zero;
+    for( int r = 0; r < Rules::SpawnOutOf; r++) {
+        code |= (SimVector)( roll == (zero + (unsigned char) r))
+                & (zero + (unsigned char) Rules::tileCode( Rules::spawnValue( r)));
+    }
+
+    // Walk the squares counting open ones; the piece goes where the count reaches the target
+    SimVector seen = zero;
+    for( int i = 0; i < squareCount; i++) {
+        SimVector empty = (SimVector)( cells[ i] == zero);
+        cells[ i] |= code & placing & empty & (SimVector)( seen == target);
+        seen -= empty;
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Random numbers used by game number gameNumber of a simulation, in either engine.
+FastRandom simulationRandom( uint64_t seed, long long gameNumber)
+{
+    return FastRandom( seed ^ (0x9E3779B97F4A7C15ULL * (uint64_t)( gameNumber + 1)));
+}
+
+
+//---------------------------------------------------------------------------------------
+// Play gameCount random games of up to maxMoves moves each, one game at a time, using
+// makeFastMove() through playRandomMove().  This is the reference the batched engine is
+// checked against.
+template <typename Rules = ClassicRules>
+void simulateScalar( int squaresPerSide, long long gameCount, int maxMoves, uint64_t seed,
+                     std::vector<SimulationResult> &results)
+{
+    TRACE_SCOPE( "simulateScalar");
+    int n = squaresPerSide;
+    results.resize( gameCount);
+    for( long long game = 0; game < gameCount; game++) {
+        FastRandom random = simulationRandom( seed, game);
+        int board[ MaxBoardSize * MaxBoardSize];
+        for( int i = 0; i < n * n; i++) {
+            board[ i] = 0;
+        }
+        placeRandomFast<Rules>( board, n, random);
+        placeRandomFast<Rules>( board, n, random);
+        results[ game].moves = 0;
+        results[ game].score = 0;
+        while( results[ game].moves < maxMoves && playRandomMove<Rules>( board, n, results[ game].score, random)) {
+            results[ game].moves++;
+        }
+        for( int i = 0; i < n * n; i++) {
+            results[ game].codes[ i] = Rules::tileCode( board[ i]);
+        }
+    }
+}
+
+
+//---------------------------------------------------------------------------------------
+// Play the same games as simulateScalar(), SimLanes games at a time.  When a game ends, the
+// next game not yet started takes over its lane, so the lanes stay busy until the end.
+template <typename Rules = ClassicRules>
+void simulateBatched( int squaresPerSide, long long gameCount, int maxMoves, uint64_t seed,
+                      std::vector<SimulationResult> &results)
+{
+    TRACE_SCOPE( "simulateBatched");
+    int n = squaresPerSide;
+    int squareCount = n * n;
+    results.resize( gameCount);
+
+    // The squares of each line for every direction, in the order the tiles slide
+    int lineSquares[ 4][ MaxBoardSize][ MaxBoardSize];
+    for( int k = 0; k < n; k++) {
+        for( int i = 0; i < n; i++) {
+            lineSquares[ 0][ k][ i] = getIndex( i, k, n);           // 'W'
+            lineSquares[ 1][ k][ i] = getIndex( k, i, n);           // 'A'
+            lineSquares[ 2][ k][ i] = getIndex( n - 1 - i, k, n);   // 'S'
+            lineSquares[ 3][ k][ i] = getIndex( k, n - 1 - i, n);   // 'D'
+        }
+    }
+
+    const SimVector zero = {};
+    SimVector cells[ MaxBoardSize * MaxBoardSize];
+    SimVector rows[ MaxBoardSize * MaxBoardSize];
+    SimVector changed[ 4];
+    SimVector chosenMask[ 4];
+    SimVector active = zero;   // Lanes playing a game
+    SimWideVector points;
+    SimWideVector laneScore = {};
+    SimIntVector laneMoves = {};
+    long long laneGame[ SimLanes];
+    SimWideVector randomState = {};
+    long long nextGame = 0;
+    int activeLanes = 0;
+
+    // Start a new game in a lane, or leave the lane empty if every game has started
+    std::function<void(int)> startGame = [&]( int lane) {
+        for( int i = 0; i < squareCount; i++) {
+            cells[ i][ lane] = 0;
+        }
+        if( nextGame >= gameCount) {
+            laneGame[ lane] = -1;
+            active[ lane] = 0;
+            return;
+        }
+        laneGame[ lane] = nextGame;
+        FastRandom random = simulationRandom( seed, nextGame);
+        laneScore[ lane] = 0;
+        laneMoves[ lane] = 0;
+        nextGame++;
+        activeLanes++;
+        placeRandomLane<Rules>( cells, squareCount, lane, random);
+        placeRandomLane<Rules>( cells, squareCount, lane, random);
+        randomState[ lane] = random.state;
+        active[ lane] = 0xFF;
+    };
+    for( int lane = 0; lane < SimLanes; lane++) {
+        startGame( lane);
+    }
+
+    while( activeLanes > 0) {
+        // Which moves change each game's board: somewhere along a line there is an empty
+        // square followed by a tile, or two tiles next to each other that can combine.  Each
+        // pair of neighbors is looked at once for both directions along it, since tiles that
+        // combine one way combine the other way too.
+        SimVector canCombine[ 2] = { zero, zero };   // Along columns, along rows
+        for( int d = 0; d < 4; d++) {
+            changed[ d] = zero;
+        }
+        for( int k = 0; k < n; k++) {
+            for( int i = 0; i < n - 1; i++) {
+                for( int along = 0; along < 2; along++) {
+                    SimVector first = cells[ lineSquares[ along][ k][ i]];
+                    SimVector second = cells[ lineSquares[ along][ k][ i + 1]];
+                    SimVector firstEmpty = (SimVector)( first == zero);
+                    SimVector secondEmpty = (SimVector)( second == zero);
+                    changed[ along] |= firstEmpty & ~secondEmpty;
+                    changed[ along + 2] |= secondEmpty & ~firstEmpty;
+                    canCombine[ along] |= ~firstEmpty & ~secondEmpty & Rules::canMergeCodes( first, second);
+                }
+            }
+        }
+        for( int d = 0; d < 4; d++) {
+            changed[ d] |= canCombine[ d % 2];
+        }
+
+        // Each game picks its move with its own random numbers, like playRandomMove(): the
+        // first direction that changes the board, starting from a random one.  Trying the
+        // directions from last to first leaves the first one that works.
+        SimVector first = nextIntLanes( randomState, active, zero + (unsigned char) 4);
+        SimVector chosen = zero + (unsigned char) 4;   // No move
+        for( int d = 3; d >= 0; d--) {
+            SimVector direction = (first + (unsigned char) d) & (unsigned char) 3;
+            SimVector works = zero;
+            for( int e = 0; e < 4; e++) {
+                works |= changed[ e] & (SimVector)( direction == (zero + (unsigned char) e));
+            }
+            chosen = (direction & works) | (chosen & ~works);
+        }
+        for( int d = 0; d < 4; d++) {
+            chosenMask[ d] = (SimVector)( chosen == (zero + (unsigned char) d));
+        }
+        SimVector moved = (SimVector)( chosen != (zero + (unsigned char) 4));
+        points = (SimWideVector) {};
+
+        // Turn every board so its chosen move slides along rows towards the start
+        for( int k = 0; k < n; k++) {
+            for( int i = 0; i < n; i++) {
+                SimVector value = zero;
+                for( int d = 0; d < 4; d++) {
+                    value |= cells[ lineSquares[ d][ k][ i]] & chosenMask[ d];
+                }
+                rows[ k * n + i] = value;
+            }
+        }
+        for( int k = 0; k < n; k++) {
+            slideLanes<Rules>( &rows[ k * n], n, points);
+        }
+        // Turn them back, leaving games that could not move alone
+        for( int d = 0; d < 4; d++) {
+            for( int k = 0; k < n; k++) {
+                for( int i = 0; i < n; i++) {
+                    SimVector &cell = cells[ lineSquares[ d][ k][ i]];
+                    cell = (rows[ k * n + i] & chosenMask[ d]) | (cell & ~chosenMask[ d]);
+                }
+            }
+        }
+
+        // A random piece in every game that moved, then scores and games that have ended.  A
+        // game ends when it could not move or has made maxMoves moves, which is when
+        // maxMoves - 1 - moves goes negative and its sign bit fills the lane.
+        placeRandomLanes<Rules>( cells, squareCount, moved, randomState);
+        laneScore += points;
+        SimIntVector movedOnce;
+        widenToInt( moved & (unsigned char) 1, movedOnce);
+        laneMoves += movedOnce;
+        SimVector finished = active & (~moved | narrowToLanes( (maxMoves - 1 - laneMoves) >> 31));
+        if( anyLane( finished)) {
+            for( int lane = 0; lane < SimLanes; lane++) {
+                if( finished[ lane]) {
+                    SimulationResult &result = results[ laneGame[ lane]];
+                    result.score = laneScore[ lane];
+                    result.moves = laneMoves[ lane];
+                    for( int i = 0; i < squareCount; i++) {
+                        result.codes[ i] = cells[ i][ lane];
+                    }
+                    activeLanes--;
+                    startGame( lane);
                 }
             }
-            break;
+        }
     }
 }
 
-//this function is checking if my board is full or not.
-bool boardFull(int board[]){
-    int row;
-    int col;
-    int squaresPerSide = 4;
-    
-    //checking if the board have empty space.
-    for ( int i = 0; i < squaresPerSide*squaresPerSide; i++){
-        if(board[i] == 0){
-            return false;
+
+//---------------------------------------------------------------------------------------
+// Run the same random games with both engines, check that they agree, and report the
+// number of games per second of each, along with how many games reached the goal.
+// Run it using:   ./sfml-app --simulate <games> [size] [maxMoves] [classic|2048|fibonacci]
+template <typename Rules = ClassicRules>
+void runSimulation( long long gameCount, int squaresPerSide, int maxMoves)
+{
+    if( squaresPerSide < 4 || squaresPerSide > MaxBoardSize) {
+        std::cout << "Board size must be between 4 and " << MaxBoardSize << std::endl;
+        return;
+    }
+    uint64_t seed = (uint64_t) time( NULL);
+    std::vector<SimulationResult> scalarResults;
+    std::vector<SimulationResult> batchedResults;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    simulateScalar<Rules>( squaresPerSide, gameCount, maxMoves, seed, scalarResults);
+    double scalarSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    simulateBatched<Rules>( squaresPerSide, gameCount, maxMoves, seed, batchedResults);
+    double batchedSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start).count();
+
+    long long mismatches = 0;
+    long long totalScore = 0;
+    long long totalMoves = 0;
+    long long reachedGoal = 0;
+    int goalCode = Rules::tileCode( Rules::goal( squaresPerSide));
+    for( long long game = 0; game < gameCount; game++) {
+        const SimulationResult &a = scalarResults[ game];
+        const SimulationResult &b = batchedResults[ game];
+        if( a.score != b.score || a.moves != b.moves
+            || memcmp( a.codes, b.codes, squaresPerSide * squaresPerSide) != 0) {
+            mismatches++;
         }
+        totalScore += a.score;
+        totalMoves += a.moves;
+        reachedGoal += (*std::max_element( a.codes, a.codes + squaresPerSide * squaresPerSide) >= goalCode);
     }
-        
-    //checking if the collum can combine or not.
-    for( int i = 0; i < squaresPerSide; i++){
-        for (int j = 0; j < squaresPerSide - 1; j++){                    
-            if(board[getIndex(i,j,squaresPerSide)] == board[getIndex(i,j+1,squaresPerSide)]){
-                return false;
+    std::cout << gameCount << " games on " << squaresPerSide << "x" << squaresPerSide
+              << " with " << Rules::getName() << " rules"
+              << ": average score " << totalScore / std::max( 1LL, gameCount)
+              << ", average moves " << totalMoves / std::max( 1LL, gameCount) << std::endl;
+    std::cout << "Reached " << Rules::goal( squaresPerSide) << " in " << reachedGoal << " games" << std::endl;
+    std::cout << "Scalar:  " << gameCount / scalarSeconds << " games/sec" << std::endl;
+    std::cout << "Batched: " << gameCount / batchedSeconds << " games/sec ("
+              << scalarSeconds / batchedSeconds << "x)" << std::endl;
+    std::cout << (mismatches == 0 ? "All games identical in both engines"
+                                  : "*** Engines disagree ***")
+              << (mismatches == 0 ? "" : (" on " + std::to_string( mismatches) + " games")) << std::endl;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Per-thread training totals.  Each sits on its own cache line so threads never share one.
+struct alignas( 64) TrainingCounters {
+    long long games;
+    long long moves;
+    long long totalScore;
+    int bestTile;
+};
+
+
+//---------------------------------------------------------------------------------------
+// Play self-play games and learn from them with TD(0) on the boards reached after each move
+// (before the random piece is placed).  Every thread runs this on its own random numbers,
+// updating the shared weights.
+void trainingThread( int threadNumber, long long gamesToPlay, float learningRate,
+                     std::atomic<long long> *pGamesStarted, TrainingCounters *pCounters)
+{
+    FastRandom random( 0x9E3779B97F4A7C15ULL * (threadNumber + 1) ^ (uint64_t) time( NULL));
+
+    while( pGamesStarted->fetch_add( 1) < gamesToPlay) {
+        TRACE_SCOPE( "training game");
+        PackedBoard packed = placeRandomPacked( placeRandomPacked( 0, random), random);
+        PackedBoard previousAfter = 0;
+        bool havePrevious = false;
+        int score = 0;
+
+        while( true) {
+            PackedBoard after = 0;
+            int points = 0;
+            char direction = chooseTupleMove( packed, after, points);
+            if( direction == ' ') {
+                break;   // No more available moves.  Game is over.
             }
+            if( havePrevious) {
+                // Move the previous value towards the reward plus the value of what followed
+                float error = points + evaluateTuples( after) - evaluateTuples( previousAfter);
+                updateTuples( previousAfter, learningRate * error);
+            }
+            previousAfter = after;
+            havePrevious = true;
+            score += points;
+            packed = placeRandomPacked( after, random);
+            pCounters->moves++;
+        }
+        if( havePrevious) {
+            // Nothing follows the final board, so its value should be 0
+            updateTuples( previousAfter, -learningRate * evaluateTuples( previousAfter));
+        }
+
+        int bestTile = 0;
+        for( int i = 0; i < PackedSide * PackedSide; i++) {
+            int exponent = (packed >> (4 * i)) & 0xF;
+            if( exponent > bestTile) {
+                bestTile = exponent;
+            }
+        }
+        pCounters->games++;
+        pCounters->totalScore += score;
+        if( bestTile > pCounters->bestTile) {
+            pCounters->bestTile = bestTile;
         }
     }
-    
-    //checking if the row can combine or not.
-    for (int j = 0; j < squaresPerSide; j++){   
-        for( int i = 0; i < squaresPerSide-1; i++){          
-            if(board[getIndex(i,j,squaresPerSide)] == board[getIndex(i+1,j,squaresPerSide)]){
-                return false;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Headless trainer: play the given number of self-play games across the given number of
+// threads, saving the weights to the checkpoint file after every batch of games.
+// Run it using:   ./sfml-app --train <games> [threads] [weightsFile]
+void runTrainer( long long gamesToPlay, int threadCount, const char *weightsFile)
+{
+    const long long GamesPerCheckpoint = 10000;
+    const float LearningRate = 0.0025f;
+
+    initializeMoveTables();
+    initializeTupleWeights();
+    if( loadTupleWeights( weightsFile)) {
+        std::cout << "Continuing training from " << weightsFile << std::endl;
+    }
+    if( threadCount < 1) {
+        threadCount = 1;
+    }
+    std::cout << "Training on " << gamesToPlay << " games with " << threadCount << " threads" << std::endl;
+
+    std::vector<TrainingCounters> counters( threadCount);
+    long long gamesDone = 0;
+    long long totalMoves = 0;
+    double totalSeconds = 0;
+    while( gamesDone < gamesToPlay) {
+        long long batch = std::min( GamesPerCheckpoint, gamesToPlay - gamesDone);
+        std::atomic<long long> gamesStarted( 0);
+        for( int t = 0; t < threadCount; t++) {
+            counters[ t] = TrainingCounters();
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for( int t = 0; t < threadCount; t++) {
+            threads.push_back( std::thread( trainingThread, t, batch, LearningRate, &gamesStarted, &counters[ t]));
+        }
+        for( int t = 0; t < threadCount; t++) {
+            threads[ t].join();
+        }
+        double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start).count();
+
+        long long moves = 0;
+        long long scoreSum = 0;
+        int bestTile = 0;
+        for( int t = 0; t < threadCount; t++) {
+            moves += counters[ t].moves;
+            scoreSum += counters[ t].totalScore;
+            bestTile = std::max( bestTile, counters[ t].bestTile);
+        }
+        gamesDone += batch;
+        totalMoves += moves;
+        totalSeconds += seconds;
+
+        bool saved = saveTupleWeights( weightsFile);
+        std::cout << "Games " << gamesDone << ": average score " << scoreSum / batch
+                  << ", best tile " << (1 << bestTile)
+                  << ", " << (long long)( moves / seconds) << " moves/sec ("
+                  << (long long)( moves / seconds / threadCount) << " per thread)"
+                  << (saved ? "" : "  *** Unable to save weights ***") << std::endl;
+    }
+    std::cout << "Done: " << totalMoves << " moves in " << totalSeconds << " seconds, "
+              << (long long)( totalMoves / totalSeconds / threadCount) << " moves/sec per core" << std::endl;
+}
+
+
+//---------------------------------------------------------------------------------------
+// Drawing the window on its own thread.  The game (main()) waits on cin and may spend a long
+// time in a move or the AI, so the window is created, polled and drawn by a render thread
+// instead, at its own rate.  The game hands over what to draw through a triple buffer: it
+// fills the back slot and publishes it, the render thread takes the newest published slot,
+// and neither side ever waits for the other or sees a half written state.
+template <typename State>
+class TripleBuffer {
+	public:
+		TripleBuffer() : middle( 1)
+		{
+			back = 0;
+			front = 2;
+		}
+
+		// The writer fills in the back slot, then publishes it
+		State &getBack() { return slots[ back]; }
+		void publish() { back = middle.exchange( back | FreshBit, std::memory_order_acq_rel) & IndexMask; }
+
+		// The reader takes the newest published slot, if there is one it has not seen.
+		// Returns false if there was nothing new.
+		bool update()
+		{
+			if( (middle.load( std::memory_order_relaxed) & FreshBit) == 0) {
+				return false;
+			}
+			front = middle.exchange( front, std::memory_order_acq_rel) & IndexMask;
+			return true;
+		}
+		const State &getFront() { return slots[ front]; }
+
+	private:
+		static const int IndexMask = 3;
+		static const int FreshBit = 4;     // Set in middle when it holds a slot not yet read
+
+		State slots[ 3];
+		int back;                          // Only used by the writer
+		std::atomic<int> middle;           // Slot index passed between them, plus FreshBit
+		int front;                         // Only used by the reader
+
+}; //end class TripleBuffer
+
+// Everything the window shows, filled in completely on every publish
+struct RenderState {
+    int board[ MaxBoardSize * MaxBoardSize];
+    int squaresPerSide;
+    int move;
+    bool showHud;
+    double lastMove;            // Move engine times, from the game thread's PerformanceHud
+    double moveTotal;
+    long long moveCount;
+    double lastTextDisplay;
+    size_t historyBytes;
+    int historyLength;
+    int hintPosition;           // A background hint is only shown if it was for this position
+};
+
+// Time between frames.  Frames are only drawn when there is a new state, an event, or the
+// performance display is showing, so an idle game uses almost no time drawing.
+const int RenderFrameMilliseconds = 16;
+
+class RenderThread {
+	public:
+		// The thread, and with it the window, is only started by the first publish(), so that
+		// the game is set up without waiting on the window and nothing is made if nothing is shown
+		RenderThread()
+		{
+			stopping = false;
+			isOpen = true;
+			hint = -1;
+		}
+
+		~RenderThread() { stop(); }
+
+		// Fill in getState(), then publish() it for the window to show
+		RenderState &getState() { return buffer.getBack(); }
+		void publish()
+		{
+			buffer.publish();
+			if( !thread.joinable()) {
+				thread = std::thread( &RenderThread::renderLoop, this);
+			}
+		}
+
+		// False once the window has been closed
+		bool getIsOpen() { return isOpen.load( std::memory_order_relaxed); }
+
+		// Show a hint worked out in the background, if position is still the one being shown.
+		// May be called from any thread.
+		void showHint( int position, char direction) { hint = position * 256 + (unsigned char) direction; }
+
+		// Draw any state already published, then close the window and end the thread
+		void stop()
+		{
+			if( thread.joinable()) {
+				stopping = true;
+				thread.join();
+			}
+		}
+
+	private:
+		void renderLoop()
+		{
+			// SFML windows belong to the thread that creates them, so everything is made here
+			std::chrono::steady_clock::time_point windowStart = std::chrono::steady_clock::now();
+			sf::RenderWindow window( sf::VideoMode( WindowXSize, WindowYSize), "Program 5: 1024");
+			double windowMilliseconds = millisecondsSince( windowStart);
+			std::chrono::steady_clock::time_point fontStart = std::chrono::steady_clock::now();
+			sf::Font font;
+			initializeFont( font);
+			double fontMilliseconds = millisecondsSince( fontStart);
+			// Create the messages label at the bottom of the graphics screen, for displaying debugging information
+			sf::Text messagesLabel( "Welcome to 1024", font, 20);
+			messagesLabel.setColor( sf::Color( 255, 255, 255));
+			messagesLabel.setPosition( 0, WindowYSize - messagesLabel.getCharacterSize() - 5);
+			// The performance display sits just above the messages label, below a 4x4 board
+			sf::Text hudLabel( "", font, 12);
+			hudLabel.setColor( sf::Color( 255, 255, 0));
+			hudLabel.setPosition( 0, WindowYSize - messagesLabel.getCharacterSize() - 5 - 4 * 16);
+			// The graphical board, an array of Square objects set to be the max size it will ever be
+			std::vector<Square> squaresArray( MaxBoardSize * MaxBoardSize);
+			PerformanceHud hud;
+			bool haveState = false;
+			int shownHint = -1;
+			window.display();
+
+			while( true) {
+				bool lastFrame = stopping.load();      // Read before taking the state, so the final one is drawn
+				bool redraw = false;
+				sf::Event event;
+				while( window.pollEvent( event)) {
+					if( event.type == sf::Event::Closed) {
+						window.close();
+						isOpen = false;
+					}
+					redraw = true;
+				}
+				if( buffer.update()) {
+					haveState = true;
+					redraw = true;
+				}
+				if( hint.load() != shownHint) {
+					shownHint = hint.load();
+					redraw = true;
+				}
+				const RenderState &state = buffer.getFront();
+				if( haveState && window.isOpen() && (redraw || state.showHud)) {
+					bool firstFrame = (hud.getFrameCount() == 0);
+					drawFrame( window, font, messagesLabel, hudLabel, &squaresArray[ 0], hud, state, shownHint);
+					if( firstFrame) {
+						hud.setStartup( windowMilliseconds, fontMilliseconds, millisecondsSince( programStart));
+					}
+				}
+				if( lastFrame) {
+					break;
+				}
+				std::this_thread::sleep_for( std::chrono::milliseconds( RenderFrameMilliseconds));
+			}
+			if( window.isOpen()) {
+				window.close();
+			}
+		}
+
+		void drawFrame( sf::RenderWindow &window, sf::Font &font, sf::Text &messagesLabel, sf::Text &hudLabel,
+		                Square squaresArray[], PerformanceHud &hud, const RenderState &state, int shownHint)
+		{
+			std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+			long long frameDrawCalls = drawCallCount;
+			int squaresPerSide = state.squaresPerSide;
+			{
+				TRACE_SCOPE( "build squares");
+				for( int i = 0; i < squaresPerSide; i++) {
+					for( int j = 0; j < squaresPerSide; j++) {
+						char nameBoard[ 81];
+						if( state.board[ i * squaresPerSide + j] == 0) {
+							strcpy( nameBoard, "");
+						}
+						else {
+							sprintf( nameBoard, "%d", state.board[ i * squaresPerSide + j]);
+						}
+						squaresArray[ i * squaresPerSide + j] = Square( 90, 90 * j + j * 10, 90 * i + i * 10, sf::Color::Blue, true, nameBoard);
+					}
+				}
+			}
+
+			std::chrono::steady_clock::time_point renderStart = std::chrono::steady_clock::now();
+			{
+				TRACE_SCOPE( "SFML render");
+				window.clear();
+				for( int i = 0; i < squaresPerSide * squaresPerSide; i++) {
+					drawCounted( window, squaresArray[ i].getTheSquare());
+					squaresArray[ i].displayText( &window, font, sf::Color( 255, 255, 255), SquareTextSize);
+				}
+				char aString[ 81];
+				sprintf( aString, "Move %d", state.move);
+				char direction = (char) (shownHint & 255);
+				if( shownHint >= 0 && shownHint / 256 == state.hintPosition && direction != ' ') {
+					sprintf( aString, "Move %d    Hint: %c", state.move, direction);
+				}
+				messagesLabel.setString( aString);
+				drawCounted( window, messagesLabel);
+				if( state.showHud) {
+					hud.setMoveTimes( state.lastMove, state.moveTotal, state.moveCount);
+					hud.addTextDisplay( state.lastTextDisplay);
+					hudLabel.setString( hud.describe( state.historyBytes, state.historyLength));
+					drawCounted( window, hudLabel);
+				}
+				window.display();
+			}
+			hud.addFrame( millisecondsSince( frameStart), millisecondsSince( renderStart), drawCallCount - frameDrawCalls);
+		}
+
+		TripleBuffer<RenderState> buffer;
+		std::atomic<bool> stopping;
+		std::atomic<bool> isOpen;
+		std::atomic<int> hint;             // position * 256 + direction, or -1 for none
+		std::thread thread;
+
+}; //end class RenderThread
+
+
+// Hand the game's current state to the render thread
+void publishRenderState( RenderThread &renderThread, int board[], int squaresPerSide, int move,
+                         PerformanceHud &hud, Timeline &timeline, int hintPosition)
+{
+    TRACE_SCOPE( "publish");
+    RenderState &state = renderThread.getState();
+    memcpy( state.board, board, squaresPerSide * squaresPerSide * sizeof( int));
+    state.squaresPerSide = squaresPerSide;
+    state.move = move;
+    state.showHud = hud.getIsVisible();
+    state.lastMove = hud.getLastMove();
+    state.moveTotal = hud.getMoveTotal();
+    state.moveCount = hud.getMoveCount();
+    state.lastTextDisplay = hud.getLastTextDisplay();
+    state.historyBytes = timeline.getMemoryUsed();
+    state.historyLength = timeline.getLength();
+    state.hintPosition = hintPosition;
+    renderThread.publish();
+}
+
+
+//---------------------------------------------------------------------------------------
+// Working out a hint while the player thinks.  The game spends most of its time waiting on
+// cin, so as soon as a board is shown a hint thread runs the Monte Carlo advisor on it.  When
+// it finishes the direction appears in the window, and 'm' shows it at once rather than
+// searching for half a second.  Input stops the search at the end of its current batch of
+// playouts, before the board is changed.  Before searching, the hint thread also works out
+// the board after each of the four moves, so making one of them only has to copy it.
+class BackgroundHint {
+	public:
+		BackgroundHint( ThreadPool &pool, std::vector<FastRandom> &randoms, RenderThread &renderThread)
+			: pool( pool), randoms( randoms), renderThread( renderThread)
+		{
+			position = 0;
+			requested = false;
+			busy = false;
+			quitting = false;
+			finished = false;
+			haveSuccessors = false;
+			cancelled = false;
+			direction = ' ';
+			thread = std::thread( &BackgroundHint::hintLoop, this);
+		}
+
+		~BackgroundHint()
+		{
+			stop();
+			{
+				std::lock_guard<std::mutex> lock( mutex);
+				quitting = true;
+			}
+			wake.notify_one();
+			thread.join();
+		}
+
+		// Start working out a hint for this board, which becomes position getPosition()
+		void start( int board[], int squaresPerSide)
+		{
+			std::lock_guard<std::mutex> lock( mutex);
+			copyBoard( board, this->board, squaresPerSide, 0);
+			this->squaresPerSide = squaresPerSide;
+			position++;
+			finished = false;
+			haveSuccessors = false;
+			cancelled = false;
+			requested = true;
+			wake.notify_one();
+		}
+
+		// Stop working on the hint, and wait until the hint thread has let go of the advisor's
+		// thread pool.  Returns the hint if it was finished, otherwise ' '.
+		char stop()
+		{
+			std::unique_lock<std::mutex> lock( mutex);
+			cancelled = true;
+			requested = false;
+			idle.wait( lock, [this] { return !busy; });
+			position++;                    // Whatever the board becomes, the old hint is out of date
+			return finished ? direction : ' ';
+		}
+
+		// The four moves from the board given to start(), and how long the hint thread took to
+		// work them out, if it got to them before stop().  Returns false if not, such as when
+		// input arrived straight away.
+		bool getSuccessors( Successors &result, double &milliseconds)
+		{
+			std::lock_guard<std::mutex> lock( mutex);
+			if( haveSuccessors) {
+				result = successors;
+				milliseconds = successorMilliseconds;
+			}
+			return haveSuccessors;
+		}
+
+		// Only changed by the game thread, in start() and stop()
+		int getPosition() { return position; }
+
+	private:
+		void hintLoop()
+		{
+			std::unique_lock<std::mutex> lock( mutex);
+			while( true) {
+				wake.wait( lock, [this] { return requested || quitting; });
+				if( quitting) {
+					break;
+				}
+				requested = false;
+				busy = true;
+				int searchBoard[ MaxBoardSize * MaxBoardSize];
+				int n = squaresPerSide;
+				int searchPosition = position;
+				copyBoard( board, searchBoard, n, 0);
+				lock.unlock();
+
+				Successors moves;
+				std::chrono::steady_clock::time_point successorStart = std::chrono::steady_clock::now();
+				{
+					TRACE_SCOPE( "speculate");
+					computeSuccessors( searchBoard, n, moves);
+				}
+				double milliseconds = millisecondsSince( successorStart);
+				lock.lock();
+				if( searchPosition == position) {
+					successors = moves;
+					successorMilliseconds = milliseconds;
+					haveSuccessors = true;
+				}
+				lock.unlock();
+
+				char found;
+				{
+					TRACE_SCOPE( "background hint");
+					found = monteCarloMove( searchBoard, n, AdvisorPlayouts, AdvisorMilliseconds, pool, randoms, &cancelled);
+				}
+
+				lock.lock();
+				if( !cancelled && searchPosition == position) {
+					direction = found;
+					finished = true;
+					renderThread.showHint( searchPosition, found);
+				}
+				busy = false;
+				idle.notify_all();
+			}
+		}
+
+		ThreadPool &pool;
+		std::vector<FastRandom> &randoms;
+		RenderThread &renderThread;
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable wake;      // A hint has been asked for, or it is time to quit
+		std::condition_variable idle;      // The hint thread has stopped searching
+		int board[ MaxBoardSize * MaxBoardSize];
+		int squaresPerSide;
+		int position;                      // Counts the boards hints have been asked for
+		bool requested;
+		bool busy;
+		bool quitting;
+		bool finished;                     // direction is the hint for the current position
+		char direction;
+		bool haveSuccessors;               // successors are the moves from the current position
+		Successors successors;
+		double successorMilliseconds;       // Time taken to work out successors
+		std::atomic<bool> cancelled;       // Read by the advisor between batches
+
+}; //end class BackgroundHint
+
+
+//---------------------------------------------------------------------------------------
+// Watching many AI games at once, as a grid of boards in one window.
+// Run it using:   ./sfml-app --watch <games> [size] [movesPerSecond] [threads]
+// A game thread moves every game once per step on a thread pool, using the same AI as the
+// 'h' hint, and starts a game again once it is over.  Each step is handed to the window
+// through a triple buffer, so the games never wait for drawing or the other way round.
+// However many games there are, the window draws them with three draw calls: one vertex
+// array holds a quad for every tile, another holds a quad for every digit, textured from
+// the font's own page of glyphs, and the third call draws the label.
+const int WatchWindowSize = 960;      // Width and height of the grid of boards
+const int WatchLabelHeight = 24;      // Room for the label below the grid
+
+struct WatchState {
+    std::vector<unsigned char> exponents;   // Every game's board, one after another
+    long long movesMade;
+    long long gamesFinished;
+};
+
+// Where everything goes: the games are laid out in columns of square cells, each holding
+// one board with a margin around it.
+struct WatchLayout {
+    int columns;
+    float cellSize;
+    float margin;
+    float tilePitch;                  // Distance from one tile to the next
+    float tileSize;
+    unsigned int characterSize;
+};
+
+WatchLayout watchLayout( int gameCount, int squaresPerSide)
+{
+    WatchLayout layout;
+    layout.columns = (int) ceil( sqrt( (double) gameCount));
+    int rows = (gameCount + layout.columns - 1) / layout.columns;
+    layout.cellSize = (float) WatchWindowSize / std::max( layout.columns, rows);
+    layout.margin = layout.cellSize * 0.04f;
+    layout.tilePitch = (layout.cellSize - 2 * layout.margin) / squaresPerSide;
+    layout.tileSize = layout.tilePitch * 0.9f;
+    layout.characterSize = (unsigned int) std::max( 6.0f, layout.tileSize * 0.45f);
+    return layout;
+}
+
+// The digits, loaded once into the font's texture at the size the tiles use
+struct DigitGlyphs {
+    sf::FloatRect bounds[ 10];        // Relative to the pen position on the baseline
+    sf::IntRect textureRect[ 10];
+    float advance[ 10];
+    float height;                     // Height of a digit above the baseline
+};
+
+void loadDigitGlyphs( const sf::Font &font, unsigned int characterSize, DigitGlyphs &glyphs)
+{
+    glyphs.height = 0;
+    for( int digit = 0; digit < 10; digit++) {
+        const sf::Glyph &glyph = font.getGlyph( '0' + digit, characterSize, false);
+        glyphs.bounds[ digit] = glyph.bounds;
+        glyphs.textureRect[ digit] = glyph.textureRect;
+        glyphs.advance[ digit] = glyph.advance;
+        glyphs.height = std::max( glyphs.height, -glyph.bounds.top);
+    }
+}
+
+// Background color of a tile, from dark grey for an empty square through blues and greens
+// to reds as the tiles grow
+sf::Color watchTileColor( int exponent)
+{
+    static const sf::Color colors[] = {
+        sf::Color( 40, 40, 48), sf::Color( 30, 60, 160), sf::Color( 30, 80, 190), sf::Color( 40, 110, 200),
+        sf::Color( 40, 140, 170), sf::Color( 40, 150, 110), sf::Color( 80, 150, 50), sf::Color( 140, 140, 30),
+        sf::Color( 180, 110, 30), sf::Color( 200, 80, 30), sf::Color( 210, 50, 40), sf::Color( 190, 30, 90),
+        sf::Color( 150, 30, 140), sf::Color( 110, 40, 170)
+    };
+    const int colorCount = sizeof( colors) / sizeof( colors[ 0]);
+    return colors[ std::min( exponent, colorCount - 1)];
+}
+
+// Add one axis-aligned quad to a vertex array of quads, with optional texture coordinates
+void appendQuad( sf::VertexArray &vertices, float left, float top, float width, float height,
+                 const sf::Color &color, const sf::IntRect &texture = sf::IntRect())
+{
+    float u = (float) texture.left;
+    float v = (float) texture.top;
+    float uWidth = (float) texture.width;
+    float vHeight = (float) texture.height;
+    vertices.append( sf::Vertex( sf::Vector2f( left, top), color, sf::Vector2f( u, v)));
+    vertices.append( sf::Vertex( sf::Vector2f( left + width, top), color, sf::Vector2f( u + uWidth, v)));
+    vertices.append( sf::Vertex( sf::Vector2f( left + width, top + height), color, sf::Vector2f( u + uWidth, v + vHeight)));
+    vertices.append( sf::Vertex( sf::Vector2f( left, top + height), color, sf::Vector2f( u, v + vHeight)));
+}
+
+// Fill tiles with a quad for every square of every game, and digits with a quad for every
+// digit of every tile value, centered on its tile and shrunk if it would not fit.
+void buildWatchVertices( const WatchState &state, int gameCount, int squaresPerSide, const WatchLayout &layout,
+                         const DigitGlyphs &glyphs, sf::VertexArray &tiles, sf::VertexArray &digits)
+{
+    int n = squaresPerSide;
+    tiles.clear();
+    digits.clear();
+    for( int game = 0; game < gameCount; game++) {
+        float boardLeft = (game % layout.columns) * layout.cellSize + layout.margin;
+        float boardTop = (game / layout.columns) * layout.cellSize + layout.margin;
+        const unsigned char *board = &state.exponents[ (size_t) game * n * n];
+        for( int i = 0; i < n; i++) {
+            for( int j = 0; j < n; j++) {
+                int exponent = board[ i * n + j];
+                float left = boardLeft + j * layout.tilePitch;
+                float top = boardTop + i * layout.tilePitch;
+                appendQuad( tiles, left, top, layout.tileSize, layout.tileSize, watchTileColor( exponent));
+                if( exponent == 0) {
+                    continue;
+                }
+                char text[ 16];
+                int length = snprintf( text, sizeof( text), "%d", 1 << exponent);
+                float width = 0;
+                for( int k = 0; k < length; k++) {
+                    width += glyphs.advance[ text[ k] - '0'];
+                }
+                float scale = std::min( 1.0f, layout.tileSize * 0.85f / std::max( width, 1.0f));
+                float penX = left + (layout.tileSize - width * scale) / 2;
+                float baseline = top + (layout.tileSize + glyphs.height * scale) / 2;
+                for( int k = 0; k < length; k++) {
+                    int digit = text[ k] - '0';
+                    const sf::FloatRect &bounds = glyphs.bounds[ digit];
+                    appendQuad( digits, penX + bounds.left * scale, baseline + bounds.top * scale,
+                                bounds.width * scale, bounds.height * scale, sf::Color::White, glyphs.textureRect[ digit]);
+                    penX += glyphs.advance[ digit] * scale;
+                }
             }
         }
-    }    
-    return true;
+    }
+}
+
+// The game thread: move every game once per step, as fast as movesPerSecond allows (0 for
+// no limit), and publish each step for the window until stopping is set.
+void advanceWatchGames( int gameCount, int squaresPerSide, int movesPerSecond, int threadCount,
+                        TripleBuffer<WatchState> &buffer, std::atomic<bool> &stopping)
+{
+    int n = squaresPerSide;
+    ThreadPool pool( threadCount);
+    std::vector<FastRandom> randoms;
+    for( int i = 0; i < pool.getThreadCount(); i++) {
+        randoms.push_back( FastRandom( (uint64_t) time( NULL) * 2654435761ULL + i));
+    }
+    std::vector<int> boards( (size_t) gameCount * n * n, 0);
+    std::vector<char> restarted( gameCount, 0);
+    for( int game = 0; game < gameCount; game++) {
+        placeRandomFast( &boards[ (size_t) game * n * n], n, randoms[ 0]);
+        placeRandomFast( &boards[ (size_t) game * n * n], n, randoms[ 0]);
+    }
+
+    long long movesMade = 0;
+    long long gamesFinished = 0;
+    while( !stopping.load()) {
+        std::chrono::steady_clock::time_point stepStart = std::chrono::steady_clock::now();
+        {
+            TRACE_SCOPE( "watch step");
+            pool.runTasks( gameCount, [&]( int worker, int game) {
+                int *board = &boards[ (size_t) game * n * n];
+                char direction = suggestMove( board, n);
+                int points = 0;
+                restarted[ game] = (direction == ' ');
+                if( restarted[ game]) {
+                    resetBoard( board, n);
+                    placeRandomFast( board, n, randoms[ worker]);
+                    placeRandomFast( board, n, randoms[ worker]);
+                }
+                else {
+                    makeFastMove( board, direction, n, points);
+                    placeRandomFast( board, n, randoms[ worker]);
+                }
+            });
+        }
+        for( int game = 0; game < gameCount; game++) {
+            gamesFinished += restarted[ game];
+            movesMade += !restarted[ game];
+        }
+
+        WatchState &state = buffer.getBack();
+        state.exponents.resize( boards.size());
+        for( int game = 0; game < gameCount; game++) {
+            boardToExponents( &boards[ (size_t) game * n * n], &state.exponents[ (size_t) game * n * n], n);
+        }
+        state.movesMade = movesMade;
+        state.gamesFinished = gamesFinished;
+        buffer.publish();
+
+        if( movesPerSecond > 0) {
+            std::this_thread::sleep_until( stepStart + std::chrono::microseconds( 1000000 / movesPerSecond));
+        }
+    }
 }
 
+void runWatch( int gameCount, int squaresPerSide, int movesPerSecond, int threadCount)
+{
+    if( gameCount < 1 || squaresPerSide < 2 || squaresPerSide > MaxBoardSize) {
+        std::cout << "Need at least one game, and a board size from 2 to " << MaxBoardSize << std::endl;
+        return;
+    }
+    TripleBuffer<WatchState> buffer;
+    std::atomic<bool> stopping( false);
+    std::thread gameThread( advanceWatchGames, gameCount, squaresPerSide, movesPerSecond, threadCount,
+                            std::ref( buffer), std::ref( stopping));
+
+    sf::RenderWindow window( sf::VideoMode( WatchWindowSize, WatchWindowSize + WatchLabelHeight),
+                             "1024: watching " + std::to_string( gameCount) + " games");
+    window.setVerticalSyncEnabled( true);
+    sf::Font font;
+    initializeFont( font);
+    WatchLayout layout = watchLayout( gameCount, squaresPerSide);
+    DigitGlyphs glyphs;
+    loadDigitGlyphs( font, layout.characterSize, glyphs);
+    sf::Text label( "", font, 16);
+    label.setColor( sf::Color( 255, 255, 0));
+    label.setPosition( 4, WatchWindowSize + 2);
+    sf::VertexArray tiles( sf::Quads);
+    sf::VertexArray digits( sf::Quads);
+
+    // Frame rate, moves per second and the slowest frame, over about a second at a time
+    std::chrono::steady_clock::time_point periodStart = std::chrono::steady_clock::now();
+    int periodFrames = 0;
+    double slowestFrame = 0;
+    long long periodStartMoves = 0;
+    long long movesMade = 0;
+    long long gamesFinished = 0;
+    bool haveState = false;
+    while( window.isOpen()) {
+        sf::Event event;
+        while( window.pollEvent( event)) {
+            if( event.type == sf::Event::Closed) {
+                window.close();
+            }
+        }
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        long long frameDrawCalls = drawCallCount;
+        if( buffer.update()) {
+            TRACE_SCOPE( "build grid");
+            const WatchState &state = buffer.getFront();
+            buildWatchVertices( state, gameCount, squaresPerSide, layout, glyphs, tiles, digits);
+            movesMade = state.movesMade;
+            gamesFinished = state.gamesFinished;
+            haveState = true;
+        }
+        {
+            TRACE_SCOPE( "SFML render");
+            window.clear();
+            if( haveState) {
+                drawCounted( window, tiles);
+                drawCounted( window, digits, sf::RenderStates( &font.getTexture( layout.characterSize)));
+            }
+            drawCounted( window, label);
+            window.display();
+        }
+        slowestFrame = std::max( slowestFrame, millisecondsSince( frameStart));
+        periodFrames++;
 
+        double seconds = millisecondsSince( periodStart) / 1000;
+        if( seconds >= 1) {
+            char text[ 256];
+            snprintf( text, sizeof( text), "%d games  %.0f moves/s  %lld finished  %.0f fps  slowest frame %.2f ms  %lld draws",
+                      gameCount, (movesMade - periodStartMoves) / seconds, gamesFinished, periodFrames / seconds,
+                      slowestFrame, drawCallCount - frameDrawCalls);
+            label.setString( text);
+            periodStart = std::chrono::steady_clock::now();
+            periodFrames = 0;
+            slowestFrame = 0;
+            periodStartMoves = movesMade;
+        }
+    }
+    stopping = true;
+    gameThread.join();
+}
 
 //---------------------------------------------------------------------------------------
-int main()
+int main( int argc, char *argv[])
 {	
+    // --simd=<level> limits the kernels to that instruction set level, for benchmarking.
+    // --trace <file> records where the time goes, written to file on exit.
+    // They may appear anywhere on the command line and are removed before the rest is read.
+    SimdLevel forcedLevel = SimdLevelCount;
+    for( int i = 1; i < argc; i++) {
+        if( strcmp( argv[ i], "--trace") == 0 && i + 1 < argc) {
+            startTracing( argv[ i + 1]);
+            for( int j = i; j < argc - 2; j++) {
+                argv[ j] = argv[ j + 2];
+            }
+            argc -= 2;
+            i--;
+        }
+        else if( strncmp( argv[ i], "--simd=", 7) == 0) {
+            for( int level = 0; level < SimdLevelCount; level++) {
+                if( strcmp( argv[ i] + 7, simdLevelNames[ level]) == 0) {
+                    forcedLevel = (SimdLevel) level;
+                }
+            }
+            for( int j = i; j < argc - 1; j++) {
+                argv[ j] = argv[ j + 1];
+            }
+            argc--;
+            i--;
+        }
+    }
+    initializeKernels( forcedLevel);
+
+    // Headless training mode:   ./sfml-app --train <games> [threads] [weightsFile]
+    if( argc >= 3 && strcmp( argv[ 1], "--train") == 0) {
+        int threadCount = (argc >= 4) ? atoi( argv[ 3]) : (int) std::thread::hardware_concurrency();
+        runTrainer( atoll( argv[ 2]), threadCount, (argc >= 5) ? argv[ 4] : "weights.bin");
+        return 0;
+    }
+    // Compare the scalar and many-game simulation engines:
+    //    ./sfml-app --simulate <games> [size] [maxMoves] [classic|2048|fibonacci]
+    if( argc >= 3 && strcmp( argv[ 1], "--simulate") == 0) {
+        long long gameCount = atoll( argv[ 2]);
+        int size = (argc >= 4) ? atoi( argv[ 3]) : 4;
+        int maxMoves = (argc >= 5) ? atoi( argv[ 4]) : 1000;
+        const char *rules = (argc >= 6) ? argv[ 5] : "classic";
+        if( strcmp( rules, "classic") == 0) {
+            runSimulation<ClassicRules>( gameCount, size, maxMoves);
+        }
+        else if( strcmp( rules, "2048") == 0) {
+            runSimulation<Rules2048>( gameCount, size, maxMoves);
+        }
+        else if( strcmp( rules, "fibonacci") == 0) {
+            runSimulation<FibonacciRules>( gameCount, size, maxMoves);
+        }
+        else {
+            std::cout << "Unknown rules " << rules << ", expected classic, 2048 or fibonacci" << std::endl;
+        }
+        return 0;
+    }
+    // Check undo, redo and jumping to a move:   ./sfml-app --check-timeline
+    if( argc >= 2 && strcmp( argv[ 1], "--check-timeline") == 0) {
+        checkTimeline();
+        return 0;
+    }
+    // Check the SIMD row kernels against the game's own moves:   ./sfml-app --check-kernels
+    if( argc >= 2 && strcmp( argv[ 1], "--check-kernels") == 0) {
+        initializeMoveTables();
+        checkKernels();
+        return 0;
+    }
+    // Stress test on a large board:   ./sfml-app --stress <size> [moves] [threads]
+    if( argc >= 3 && strcmp( argv[ 1], "--stress") == 0) {
+        int threadCount = (argc >= 5) ? atoi( argv[ 4]) : (int) std::thread::hardware_concurrency();
+        runStressTest( atoi( argv[ 2]), (argc >= 4) ? atoll( argv[ 3]) : 100, threadCount);
+        return 0;
+    }
+    // Play a script of moves at full speed:   ./sfml-app --script <file, or - for stdin> [renderEvery] [seed]
+    if( argc >= 3 && strcmp( argv[ 1], "--script") == 0) {
+        runScript( argv[ 2], (argc >= 4) ? atoi( argv[ 3]) : 0, (argc >= 5) ? (unsigned int) atoi( argv[ 4]) : 1);
+        return 0;
+    }
+    // Draw a script's game offscreen, to PNG frames or raw video:   ./sfml-app --export <script, or -> <output> [seed]
+    if( argc >= 4 && strcmp( argv[ 1], "--export") == 0) {
+        runExport( argv[ 2], argv[ 3], (argc >= 5) ? (unsigned int) atoi( argv[ 4]) : 1);
+        return 0;
+    }
+    // Serve many games to bots and test harnesses:   ./sfml-app --serve <socket path, or port> [threads]
+    if( argc >= 3 && strcmp( argv[ 1], "--serve") == 0) {
+        initializeMoveTables();
+        runServer( argv[ 2], (argc >= 4) ? atoi( argv[ 3]) : (int) std::thread::hardware_concurrency());
+        return 0;
+    }
+    // Watch many AI games at once:   ./sfml-app --watch <games> [size] [movesPerSecond] [threads]
+    if( argc >= 3 && strcmp( argv[ 1], "--watch") == 0) {
+        initializeMoveTables();
+        initializeHeuristicTable();
+        int threadCount = (argc >= 6) ? atoi( argv[ 5]) : (int) std::thread::hardware_concurrency();
+        runWatch( atoi( argv[ 2]), (argc >= 4) ? atoi( argv[ 3]) : 4, (argc >= 5) ? atoi( argv[ 4]) : 30, threadCount);
+        return 0;
+    }
+    // Headless Monte Carlo bot:   ./sfml-app --bot <size> [playoutsPerMove] [timeBudgetMilliseconds]
+    if( argc >= 3 && strcmp( argv[ 1], "--bot") == 0) {
+        initializeMoveTables();
+        runMonteCarloBot( atoi( argv[ 2]), (argc >= 4) ? atoi( argv[ 3]) : 200, (argc >= 5) ? atoi( argv[ 4]) : 500);
+        return 0;
+    }
+
     int move = 1;                     // User move counter
 	int score = 0;                    // Cummulative score, which is sum of combined tiles
     int squaresPerSide = 4;           // User will enter this value.  Set default to 4
@@ -553,29 +6267,33 @@ int main()
 													  //    if a move changed the board.
     bool byPass = false; 
     
-	// Create the graphical board, an array of Square objects set to be the max size it will ever be.
-	Square squaresArray[ MaxBoardSize * MaxBoardSize]; 
     int maxTileValue = 1024;  // 1024 for 4x4 board, 2048 for 5x5, 4096 for 6x6, etc.
     char userInput = ' ';     // Stores user input
-	char aString[ 81];        // C-string to hold concatenated output of character literals
     int newNode;
     int boardLine = 4;
     int counter;
+    ThreadPool *pAdvisorPool = NULL;        // Used by the Monte Carlo hints, including the background one
+    std::vector<FastRandom> advisorRandoms; // Random numbers for each of its threads
+    // Text board display.  Run with --ansi to redraw only what changed, in place.
+    // Run with --hud to start with the performance display showing.
+    bool useAnsi = false;
+    bool showHud = false;
+    for( int i = 1; i < argc; i++) {
+        useAnsi = useAnsi || strcmp( argv[ i], "--ansi") == 0;
+        showHud = showHud || strcmp( argv[ i], "--hud") == 0;
+    }
+    TextRenderer renderer( useAnsi);
+    PerformanceHud hud( showHud);
+    std::string message;                    // Shown under the text board on the next display
     
-	// Create the graphics window
-	sf::RenderWindow window(sf::VideoMode(WindowXSize, WindowYSize), "Program 5: 1024");
+	// The graphics window, made and drawn by its own thread once there is a board to show
+	RenderThread renderThread;
 	std::cout << std::endl;
-    // Create and initialize the font, to be used in displaying text.
-	sf::Font font;  
-	initializeFont( font);
-	// Create the messages label at the bottom of the graphics screen, for displaying debugging information
-	sf::Text messagesLabel( "Welcome to 1024", font, 20);
-	// Make a text object from the font
-	messagesLabel.setColor( sf::Color(255,255,255));
-	// Place text at the bottom of the window. Position offsets are x,y from 0,0 in upper-left of window
-	messagesLabel.setPosition( 0, WindowYSize - messagesLabel.getCharacterSize() - 5); 
 	
 	displayInstructions();
+    displayKernels();
+    initializeMoveTables();
+    initializeHeuristicTable();
         
     // Get the board size, create and initialize the board, and set the max tile value
     // ...
@@ -585,61 +6303,39 @@ int main()
     placeRandomPiece( board,  squaresPerSide);
     placeRandomPiece( board,  squaresPerSide);
     
-	Node *pHead = NULL;
-    // Declare a pointer for the head of the list.  Add a node onto the list.  
-    //    The list may grow and shrink, but this first node should always be there.
+	Timeline timeline;
+    // Declare the timeline of every position, used for undo, redo and jumping to a move.
+    //    It may grow and shrink, but the first position should always be there.
     // ...
     
     
     int arraySize = squaresPerSide*squaresPerSide;
-    
-    window.display();
 	
-	// Add the first node to the list, capturing the starting board, score, and move number.
-	// This node should always then be on the list.
-	addNode(squaresPerSide, board, move, score, pHead); 
+	// Add the first position to the timeline, capturing the starting board, score, and move number.
+	// This position should always then be on the timeline.
+	timeline.record(squaresPerSide, board, move, score); 
+	
+	// Work out a hint for each board while the player is thinking about it
+	createAdvisorPool(pAdvisorPool, advisorRandoms);
+	BackgroundHint backgroundHint(*pAdvisorPool, advisorRandoms, renderThread);
 	
 	// Run the program as long as the window is open.  This is known as the "Event loop".
-	while (window.isOpen()&&(!boardFull(board))&&(!maxGoal(board,squaresPerSide) || byPass))
+	while (renderThread.getIsOpen()&&(!boardFull(board,squaresPerSide))&&(!maxGoal(board,squaresPerSide) || byPass))
 	{
-        
-        for(int i = 0; i < squaresPerSide; i++){
-            for(int j = 0; j < squaresPerSide; j++){
-                char nameBoard[81];
-                if(board[i*squaresPerSide+j] == 0){
-                    strcpy( nameBoard, "");
-                }
-                else{
-                    sprintf( nameBoard,"%d", board[i*squaresPerSide+j]);
-                }
-                squaresArray[i*squaresPerSide+j] = Square(90,90 * j + j * 10, 90 * i + i * 10 , sf::Color::Blue, true, nameBoard);
-                window.draw(squaresArray[i*squaresPerSide+j].getTheSquare());
-                int red = 255, green = 255, blue = 255;
-                squaresArray[i*squaresPerSide+j].displayText(&window, font, sf::Color(red,green,blue), 30);
-            }
-        }
-        
-        //
-        window.clear();
-        
-        //this line for display the text
-        for( int i = 0; i < squaresPerSide; i++){
-            for(int j = 0; j < squaresPerSide; j++){
-            window.draw(squaresArray[i*squaresPerSide+j].getTheSquare());
-            int red=255,green=255,blue=255;
-            squaresArray[i*squaresPerSide+j].displayText(&window,font,sf::Color(red,green,blue),30);
-            }
-        }
-        sprintf( aString, "Move %d", move );
-        messagesLabel.setString(aString);
-        window.draw(messagesLabel);
-        
-        window.display();
+        // Start on the hint, then the render thread draws the window from this whenever it next gets to it
+        backgroundHint.start(board, squaresPerSide);
+        publishRenderState(renderThread, board, squaresPerSide, move, hud, timeline, backgroundHint.getPosition());
         byPass = false;
 		// Display both the graphical and text boards.
 		// ...
 		
-        displayBoardSize(squaresPerSide,board,score,pHead,counter);
+        std::chrono::steady_clock::time_point textStart = std::chrono::steady_clock::now();
+        {
+            TRACE_SCOPE("terminal render");
+            displayBoardSize(squaresPerSide,board,score,timeline,renderer,message);
+        }
+        hud.addTextDisplay(millisecondsSince(textStart));
+        message.clear();
         // Make a copy of the board.  After we then attempt a move, the copy will be used to 
         // verify that the board changed, which only then allows randomly placing an additional  
         // piece on the board and updating the move number.
@@ -647,29 +6343,131 @@ int main()
         copyBoard(board,previousBoard, squaresPerSide, score);
         
         // Prompt for and handle user input
+        int hintMove = move;   // The move the background hint is being worked out for
         std::cout << move << ". Your move: ";
-        std::cin >> userInput;
+        {
+            TRACE_SCOPE("input");
+            std::cin >> userInput;
+        }
+        char readyHint = backgroundHint.stop();   // ' ' if it had not finished
+        // The hint thread works out all four moves while the player is still thinking, so
+        // making one of them only has to copy its result.  If input came first, do it now.
+        // The HUD's move time is the time to work them out, wherever that was, plus making the move
+        Successors successors;
+        double successorMilliseconds = 0;
+        if(!backgroundHint.getSuccessors(successors, successorMilliseconds)){
+            std::chrono::steady_clock::time_point successorStart = std::chrono::steady_clock::now();
+            TRACE_SCOPE("speculate");
+            computeSuccessors(board, squaresPerSide, successors);
+            successorMilliseconds = millisecondsSince(successorStart);
+        }
         userInput = toupper(userInput);
+        std::chrono::steady_clock::time_point moveStart = std::chrono::steady_clock::now();
+        // x ends the program inside movePieces(), so close the window cleanly first
+        if(userInput == 'X'){
+            renderThread.stop();
+        }
 		
-		// Prompt for and get the user input, and handle the different user inputs
-        movePieces(board, userInput,squaresPerSide, score, move, pHead);
-		
-		// If user input is 'U', then undo move, and continue back up to top of loop.
-		// ...
-		
-        combine(board, userInput, squaresPerSide, score, move, pHead);
+        // W, A, S and D take the board worked out above; everything else still goes through
+        // movePieces() and combine().
+        int speculated = -1;
+        for(int d = 0; d < 4; d++){
+            if(userInput == SuccessorDirections[d]){
+                speculated = d;
+            }
+        }
+        if(speculated >= 0){
+            TRACE_SCOPE("commit move");
+            copyBoard(successors.boards[speculated], board, squaresPerSide, score);
+            score += successors.points[speculated];
+        }
+        else{
+            // Prompt for and get the user input, and handle the different user inputs
+            {
+                TRACE_SCOPE("movePieces");
+                movePieces(board, userInput,squaresPerSide, score, move, timeline);
+            }
+            
+            // If user input is 'U', then undo move, and continue back up to top of loop.
+            // ...
+            
+            {
+                TRACE_SCOPE("combine");
+                combine(board, userInput, squaresPerSide, score, move, timeline);
+            }
+        }
         
         // If the move resulted in pieces changing position, then it was a valid move
         // so place a new random piece (2 or 4) in a random open square and update move number.
         // Add the new board, moveNumber and score to a new list node at the front of the list.
         // ...
-        if ((userInput !='U')&&(userInput != 'P') && boardChanged(board,previousBoard,squaresPerSide,score) == true){
-            placeRandomPiece( board,  squaresPerSide);
+        // Redo and jumping to a move restore a position from the timeline rather than making a move
+        if(userInput == 'Y'){
+            if(!timeline.redo(squaresPerSide, board, move, score)){
+                message = "*** There is no move to redo. ***";
+            }
+        }
+        if(userInput == 'J'){
+            int moveNumber;
+            std::cin >> moveNumber;
+            if(!timeline.jumpToMove(moveNumber, squaresPerSide, board, move, score)){
+                message = "*** Move " + std::to_string(moveNumber) + " was not played in this game. ***";
+            }
+        }
+        bool timelineInput = (userInput == 'U') || (userInput == 'Y') || (userInput == 'J');
+        bool changed = (speculated >= 0) ? successors.changed[speculated] : boardChanged(board,previousBoard,squaresPerSide,score);
+        if (!timelineInput &&(userInput != 'P') && changed == true){
+            {
+                TRACE_SCOPE("spawn");
+                placeRandomPiece( board,  squaresPerSide);
+            }
             move++;
-            addNode(squaresPerSide, board, move, score, pHead);  
+            TRACE_SCOPE("history push");
+            timeline.record(squaresPerSide, board, move, score);  
+        }
+        if(userInput == 'W' || userInput == 'A' || userInput == 'S' || userInput == 'D'){
+            hud.addMove(successorMilliseconds + millisecondsSince(moveStart));
+        }
+        if(userInput == 'F'){
+            hud.toggle();
         }
         if(userInput == 'P'){
             byPass = true;
+        }
+        // These write to the terminal or read more input outside the frame, so the in-place
+        // display cannot tell where its last frame now is
+        if(userInput == 'U' || userInput == 'P' || userInput == 'R' || userInput == 'J'){
+            renderer.forceFullFrame();
+        }
+        if(userInput == 'L'){
+            appendList(message, timeline);
+        }
+        if(userInput == 'H'){
+            char hint = suggestMove(board, squaresPerSide);
+            if(hint == ' '){
+                message = "No move changes the board.";
+            }
+            else{
+                message = std::string("Hint: try moving ") + hint;
+            }
+        }
+        if(userInput == 'M'){
+            char hint = readyHint;
+            if(hint == ' '){
+                hint = monteCarloMove(board, squaresPerSide, AdvisorPlayouts, AdvisorMilliseconds, *pAdvisorPool, advisorRandoms);
+            }
+            if(hint == ' '){
+                message = "No move changes the board.";
+            }
+            else{
+                message = std::string("Monte Carlo hint: try moving ") + hint;
+            }
+        }
+        // The text display cannot show the background hint while the player is typing, so a
+        // finished one goes in the next frame, along with the move it was worked out for
+        else if(readyHint != ' '){
+            std::string hintLine = "Background hint for move " + std::to_string(hintMove) + ": " + readyHint;
+            message = message.empty() ? hintLine : message + "\n" + hintLine;
         }
 		// See if we're done
 		// ...
@@ -678,19 +6476,18 @@ int main()
 
 		// Pause the event loop, so that Codio does not think it is a runaway process and kill it after some time
 		std::this_thread::sleep_for(std::chrono::milliseconds( 50));
-	}//end while( window.isOpen())
+	}//end while( renderThread.getIsOpen())
+    publishRenderState(renderThread, board, squaresPerSide, move, hud, timeline, backgroundHint.getPosition());
     
 //when the board is full or user got max Goal the game will break.
-if(boardFull(board)){
-    displayBoardSize(squaresPerSide,board,score,pHead,counter);
-    std::cout << move << ". Your move: ";
-    std::cout << "No more available moves. Game is over." << std::endl;
-    displayBoardSize(squaresPerSide,board,score,pHead,counter);
+//the message goes in the frame, so the in-place display does not draw over it.
+if(boardFull(board,squaresPerSide)){
+    displayBoardSize(squaresPerSide,board,score,timeline,renderer,
+                     std::to_string(move) + ". Your move: No more available moves. Game is over.");
 }
 else if(maxGoal(board,squaresPerSide)){
-    std::cout <<  std::endl;
-    std::cout << "Congratulations!  You made it to " << boardGoal(squaresPerSide) << " !!!" << std::endl;
-    displayBoardSize(squaresPerSide,board,score,pHead,counter);
+    displayBoardSize(squaresPerSide,board,score,timeline,renderer,
+                     "Congratulations!  You made it to " + std::to_string(boardGoal(squaresPerSide)) + " !!!");
 }
 
 	return 0;